@@ -0,0 +1,22 @@
+#include "alloc_count.h"
+#include <new>
+#include <cstdlib>
+
+// single threaded, a plain counter will do
+static long heap_allocations = 0;
+
+long num_heap_allocations() { return heap_allocations; }
+
+#ifdef WF_COUNT_ALLOCS
+void* operator new(size_t size) {
+  heap_allocations++;
+  void* p = std::malloc(size ? size : 1);
+  if (not p) throw std::bad_alloc();
+  return p;
+}
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+#endif
@@ -0,0 +1,11 @@
+#ifndef ALLOC_COUNT_H
+#define ALLOC_COUNT_H
+
+// Test mode: build with -DWF_COUNT_ALLOCS and alloc_count.cc, which
+// replaces the global operator new to count heap allocations. The
+// simulators then check that events only allocate while growing a table
+// or scratch buffer, and replay the trace once warmed up to check that
+// no event allocates at all (see TraceSimulator::replay()).
+long num_heap_allocations();
+
+#endif
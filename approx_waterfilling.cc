@@ -0,0 +1,339 @@
+#include "approx_waterfilling.h"
+#include <algorithm>
+#include <limits>
+
+static const double unbounded = std::numeric_limits<double>::infinity();
+// fewer items than this per thread aren't worth waking the pool for
+static const int min_items_per_thread = 2048;
+
+ApproxWaterfilling::ApproxWaterfilling(const Topology& topology,
+				       PathTable& paths,
+				       int num_threads)
+  : topology(topology), paths(paths), num_threads(num_threads) {
+  if (this->num_threads <= 0) this->num_threads = std::max(1u, std::thread::hardware_concurrency());
+  thread_max.assign(this->num_threads, 0);
+  wanted_levels.resize(this->num_threads);
+  for (int t = 1; t < this->num_threads; t++) {
+    workers.emplace_back(&ApproxWaterfilling::work, this, t);
+  }
+}
+
+ApproxWaterfilling::~ApproxWaterfilling() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  start_cv.notify_all();
+  for (auto& w : workers) w.join();
+}
+
+size_t ApproxWaterfilling::capacity_held() const {
+  size_t held = path_links.capacity() + warm_level.capacity()
+    + solve_flow.capacity() + weight.capacity() + link_ids.capacity() + used_link.capacity()
+    + link_begin.capacity() + link_flows.capacity() + flow_begin.capacity() + flow_links.capacity()
+    + level.capacity() + link_weight.capacity() + link_load.capacity() + link_scale.capacity()
+    + link_max_level.capacity() + min_level.capacity() + min_link.capacity()
+    + second_level.capacity() + flow_rate.capacity();
+  for (auto& w : wanted_levels) held += w.capacity();
+  return held;
+}
+
+size_t ApproxWaterfilling::memory_bytes() const {
+  size_t bytes = path_links.capacity() * sizeof(int)
+    + (solve_flow.capacity() + link_ids.capacity() + used_link.capacity()
+       + link_begin.capacity() + link_flows.capacity() + flow_begin.capacity()
+       + flow_links.capacity() + min_link.capacity()) * sizeof(int)
+    + (warm_level.capacity() + weight.capacity() + level.capacity() + link_weight.capacity()
+       + link_load.capacity() + link_scale.capacity() + link_max_level.capacity()
+       + min_level.capacity() + second_level.capacity() + flow_rate.capacity()) * sizeof(double);
+  for (auto& w : wanted_levels) bytes += w.capacity() * sizeof(w[0]);
+  return bytes;
+}
+
+void ApproxWaterfilling::run_range(int thread) {
+  int per_thread = (job_size + num_threads - 1) / num_threads;
+  int begin = std::min(job_size, thread * per_thread);
+  int end = std::min(job_size, begin + per_thread);
+  (*job)(thread, begin, end);
+}
+
+void ApproxWaterfilling::work(int thread) {
+  long seen = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      start_cv.wait(lock, [&] { return stopping or batch != seen; });
+      if (stopping) return;
+      seen = batch;
+    }
+    run_range(thread);
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      num_busy--;
+    }
+    done_cv.notify_one();
+  }
+}
+
+void ApproxWaterfilling::run(int n, const std::function< void(int, int, int) >& body) {
+  std::fill(thread_max.begin(), thread_max.end(), 0);
+  if (workers.empty() or n < 2 * min_items_per_thread) {
+    body(0, 0, n);
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    job = &body;
+    job_size = n;
+    num_busy = workers.size();
+    batch++;
+  }
+  start_cv.notify_all();
+  run_range(0);
+  std::unique_lock<std::mutex> lock(mutex);
+  done_cv.wait(lock, [&] { return num_busy == 0; });
+}
+
+void ApproxWaterfilling::find_min_levels(int begin, int end) {
+  for (int i = begin; i < end; i++) {
+    double lowest = unbounded, second = unbounded;
+    int lowest_link = -1;
+    for (int h = flow_begin[i]; h < flow_begin[i + 1]; h++) {
+      int link = flow_links[h];
+      double lv = level[link];
+      if (lowest_link < 0 or lv < lowest) {
+	second = lowest;
+	lowest = lv;
+	lowest_link = link;
+      } else if (lv < second) {
+	second = lv;
+      }
+    }
+    min_level[i] = lowest;
+    min_link[i] = lowest_link;
+    second_level[i] = second;
+  }
+}
+
+double ApproxWaterfilling::water_level(int link, int thread) {
+  // each flow wants the lowest level its other links advertise. the
+  // water level x has sum of weight * min(wanted, x) equal to capacity:
+  // with the flows in order of what they want, the first k drop out of
+  // the share where x comes out no more than what flow k wants, and past
+  // that point it always does. search for it by selection, halving the
+  // flows left each time, so a link costs O(flows) expected
+  auto wanted_by = [&](int f) { return min_link[f] == link ? second_level[f] : min_level[f]; };
+  double cap = topology.capacity(link_ids[link]);
+  // usually no flow wants less than an even share and that's the level
+  double even = cap / link_weight[link];
+  double least = unbounded;
+  for (int i = link_begin[link]; i < link_begin[link + 1]; i++) {
+    least = std::min(least, wanted_by(link_flows[i]));
+  }
+  if (even <= least) return even;
+  std::vector< std::pair< double, double > >& wanted = wanted_levels[thread];
+  wanted.clear();
+  for (int i = link_begin[link]; i < link_begin[link + 1]; i++) {
+    int f = link_flows[i];
+    wanted.emplace_back(wanted_by(f), weight[f]);
+  }
+  // flows before lo are out of the share, from hi on they're in it
+  int lo = 0, hi = wanted.size();
+  double below = 0, sharing = 0;
+  while (lo < hi) {
+    int mid = lo + (hi - lo) / 2;
+    std::nth_element(wanted.begin() + lo, wanted.begin() + mid, wanted.begin() + hi);
+    double mid_below = 0, mid_sharing = 0;
+    for (int i = lo; i < mid; i++) mid_below += wanted[i].second * wanted[i].first;
+    for (int i = mid; i < hi; i++) mid_sharing += wanted[i].second;
+    double x = (cap - below - mid_below) / (sharing + mid_sharing);
+    if (x <= wanted[mid].first) {
+      sharing += mid_sharing;
+      hi = mid;
+    } else {
+      below += mid_below + wanted[mid].second * wanted[mid].first;
+      lo = mid + 1;
+    }
+  }
+  if (sharing == 0) return unbounded; // its flows can't fill it
+  return (cap - below) / sharing;
+}
+
+void ApproxWaterfilling::solve() {
+  int num_flows = solve_flow.size();
+  int num_links = link_ids.size();
+  std::function< void(int, int, int) > flow_pass = [&](int, int begin, int end) {
+    find_min_levels(begin, end);
+  };
+  std::function< void(int, int, int) > link_pass = [&](int thread, int begin, int end) {
+    double max_change = 0;
+    for (int l = begin; l < end; l++) {
+      double next = water_level(l, thread);
+      double change;
+      if (next == level[l]) change = 0;
+      else if (next == unbounded or level[l] == unbounded) change = 1;
+      else change = std::abs(next - level[l]) / std::max(next, level[l]);
+      max_change = std::max(max_change, change);
+      link_load[l] = next; // new levels go in after everyone has read the old
+    }
+    thread_max[thread] = max_change;
+  };
+
+  last_iterations = 0;
+  while (last_iterations < max_iterations) {
+    last_iterations++;
+    run(num_flows, flow_pass);
+    run(num_links, link_pass);
+    std::swap(level, link_load);
+    double max_change = *std::max_element(thread_max.begin(), thread_max.end());
+    if (max_change <= epsilon) break;
+  }
+  num_iterations += last_iterations;
+  run(num_flows, flow_pass);
+
+  // rates from the levels, then scaled down by the worst overload on
+  // their path so every link is within capacity
+  run(num_flows, [&](int, int begin, int end) {
+      for (int i = begin; i < end; i++) {
+	double lv = min_level[i];
+	if (lv == unbounded) {
+	  // no link holds it back yet, an even share of its tightest link
+	  for (int h = flow_begin[i]; h < flow_begin[i + 1]; h++) {
+	    int link = flow_links[h];
+	    lv = std::min(lv, topology.capacity(link_ids[link]) / link_weight[link]);
+	  }
+	}
+	flow_rate[i] = weight[i] * lv;
+      }
+    });
+  run(num_links, [&](int, int begin, int end) {
+      for (int l = begin; l < end; l++) {
+	double load = 0;
+	for (int i = link_begin[l]; i < link_begin[l + 1]; i++) load += flow_rate[link_flows[i]];
+	link_scale[l] = std::max(1.0, load / topology.capacity(link_ids[l]));
+      }
+    });
+  run(num_flows, [&](int, int begin, int end) {
+      for (int i = begin; i < end; i++) {
+	double scale = 1;
+	for (int h = flow_begin[i]; h < flow_begin[i + 1]; h++) {
+	  scale = std::max(scale, link_scale[flow_links[h]]);
+	}
+	flow_rate[i] /= scale;
+      }
+    });
+
+  // bottleneck slack: a flow is bottlenecked on a link that's full with
+  // no flow at a higher level, its slack is the least, over its links,
+  // of the larger of the link's spare capacity and its level's
+  // shortfall against the highest level there (both relative)
+  run(num_links, [&](int, int begin, int end) {
+      for (int l = begin; l < end; l++) {
+	double load = 0, highest = 0;
+	for (int i = link_begin[l]; i < link_begin[l + 1]; i++) {
+	  int f = link_flows[i];
+	  load += flow_rate[f];
+	  highest = std::max(highest, flow_rate[f] / weight[f]);
+	}
+	link_load[l] = load;
+	link_max_level[l] = highest;
+      }
+    });
+  run(num_flows, [&](int thread, int begin, int end) {
+      double worst = 0;
+      for (int i = begin; i < end; i++) {
+	double off = unbounded;
+	for (int h = flow_begin[i]; h < flow_begin[i + 1]; h++) {
+	  int l = flow_links[h];
+	  double spare = 1 - link_load[l] / topology.capacity(link_ids[l]);
+	  double shortfall = 1 - flow_rate[i] / weight[i] / link_max_level[l];
+	  off = std::min(off, std::max(spare, shortfall));
+	}
+	worst = std::max(worst, off);
+      }
+      thread_max[thread] = worst;
+    });
+  last_bottleneck_slack = *std::max_element(thread_max.begin(), thread_max.end());
+  worst_bottleneck_slack = std::max(worst_bottleneck_slack, last_bottleneck_slack);
+
+  // the levels a flow actually got warm start the next solve
+  for (int l = 0; l < num_links; l++) warm_level[link_ids[l]] = level[l];
+}
+
+template <class Weight, class Rate>
+void ApproxWaterfilling::solve_flows(const int* flow_paths, const Weight* flow_weights,
+				     int num_flows, Rate* rates) {
+  path_links.update(paths, topology);
+  num_solves++;
+  int num_topology_links = topology.num_links();
+  warm_level.resize(num_topology_links, 0);
+
+  // number the flows with paths and the links they use
+  solve_flow.clear();
+  weight.clear();
+  flow_begin.assign(1, 0);
+  flow_links.clear();
+  used_link.assign(num_topology_links, -1);
+  link_ids.clear();
+  for (int f = 0; f < num_flows; f++) {
+    int path = flow_paths[f];
+    if (path < 0) continue;
+    solve_flow.push_back(f);
+    weight.push_back(flow_weights[f]);
+    for (const int* id = path_links.begin(path); id != path_links.end(path); id++) {
+      if (used_link[*id] < 0) {
+	used_link[*id] = link_ids.size();
+	link_ids.push_back(*id);
+      }
+      flow_links.push_back(used_link[*id]);
+    }
+    flow_begin.push_back(flow_links.size());
+  }
+  int num_links = link_ids.size();
+  int n = solve_flow.size();
+  num_flows_solved += n;
+  link_begin.assign(num_links + 1, 0);
+  link_weight.assign(num_links, 0);
+  for (int i = 0; i < n; i++) {
+    for (int h = flow_begin[i]; h < flow_begin[i + 1]; h++) {
+      link_begin[flow_links[h] + 1]++;
+      link_weight[flow_links[h]] += weight[i];
+    }
+  }
+  for (int l = 0; l < num_links; l++) link_begin[l + 1] += link_begin[l];
+  link_flows.resize(link_begin[num_links]);
+  // used_link has done its job, it's the fill cursor of each link now
+  for (int l = 0; l < num_links; l++) used_link[link_ids[l]] = link_begin[l];
+  for (int i = 0; i < n; i++) {
+    for (int h = flow_begin[i]; h < flow_begin[i + 1]; h++) {
+      link_flows[used_link[link_ids[flow_links[h]]]++] = i;
+    }
+  }
+
+  // links we haven't solved before start at an even share
+  level.resize(num_links);
+  for (int l = 0; l < num_links; l++) {
+    double warm = warm_level[link_ids[l]];
+    level[l] = warm > 0 ? warm : topology.capacity(link_ids[l]) / link_weight[l];
+  }
+  link_load.resize(num_links);
+  link_scale.resize(num_links);
+  link_max_level.resize(num_links);
+  min_level.resize(n);
+  min_link.resize(n);
+  second_level.resize(n);
+  flow_rate.resize(n);
+
+  solve();
+  for (int i = 0; i < n; i++) rates[solve_flow[i]] = flow_rate[i];
+}
+
+void ApproxWaterfilling::do_waterfilling(const int* flow_paths, const double* flow_weights,
+					 int num_flows, double* rates) {
+  solve_flows(flow_paths, flow_weights, num_flows, rates);
+}
+
+void ApproxWaterfilling::do_waterfilling(const int* flow_paths, const float* flow_weights,
+					 int num_flows, float* rates) {
+  solve_flows(flow_paths, flow_weights, num_flows, rates);
+}
@@ -0,0 +1,131 @@
+#ifndef APPROX_WATERFILLING_H
+#define APPROX_WATERFILLING_H
+
+#include "waterfilling_solver.h"
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Approximate max-min rates by fixed-point iteration, for sweeps that
+// can live with rates a little off in exchange for speed. Each link
+// advertises a level (rate per unit weight): the water level it would
+// fill at if every flow on it took the least of what the flow's other
+// links advertise and the level itself. Each flow gets the lowest level
+// on its path. Exact max-min rates are the fixed point, we iterate
+// until no link's level moves by more than epsilon (relative). Every
+// iteration is one pass over the flows and one over the links, both
+// split over a pool of threads. Link levels are kept across solves, so
+// an event that changes a few flows starts close to the answer.
+//
+// Rates are scaled down where needed so no link is over capacity, and
+// each solve reports its bottleneck slack: how far the worst flow is
+// from having a bottleneck, a full link on which no flow has a higher
+// level. Exact max-min rates have slack 0, 1e-3 means every flow is
+// within 0.1% of being bottlenecked. It isn't a bound on how far rates
+// are from the exact ones, which can be several times more.
+class ApproxWaterfilling {
+ protected:
+  const Topology& topology;
+  PathTable& paths;
+  PathLinkIds path_links;
+  double epsilon = 1e-4;
+  int max_iterations = 1000;
+
+  // by topology link, each solve starts from the last one's levels
+  std::vector< double > warm_level;
+
+  // this solve: flows with a path numbered 0..n-1 (solve_flow holds
+  // their flow numbers), used links 0..num_links-1 (link_ids holds
+  // their topology ids). flows on link l are link_flows[link_begin[l]
+  // .. link_begin[l+1]-1], links of flow i flow_links[flow_begin[i] ..]
+  std::vector< int > solve_flow;
+  std::vector< double > weight;
+  std::vector< int > link_ids;
+  std::vector< int > used_link; // by topology id, -1 if unused
+  std::vector< int > link_begin;
+  std::vector< int > link_flows;
+  std::vector< int > flow_begin;
+  std::vector< int > flow_links;
+  // by used link, infinite when the link's flows can't fill it
+  std::vector< double > level;
+  std::vector< double > link_weight; // sum of its flows' weights
+  std::vector< double > link_load;
+  std::vector< double > link_scale;
+  std::vector< double > link_max_level;
+  // by flow, the lowest level on its path, where, and the next lowest
+  std::vector< double > min_level;
+  std::vector< int > min_link;
+  std::vector< double > second_level;
+  std::vector< double > flow_rate;
+  std::vector< double > thread_max; // per thread, for reductions
+  // per thread, the (wanted level, weight) of each flow on the link
+  // water_level() is working on
+  std::vector< std::vector< std::pair< double, double > > > wanted_levels;
+
+  // stats
+  long num_solves = 0;
+  long num_flows_solved = 0;
+  long num_iterations = 0;
+  int last_iterations = 0;
+  double last_bottleneck_slack = 0;
+  double worst_bottleneck_slack = 0;
+
+  // thread pool, run() splits 0..n-1 into one range per thread and
+  // returns when all are done. the caller's thread is thread 0
+  std::vector< std::thread > workers;
+  std::mutex mutex;
+  std::condition_variable start_cv;
+  std::condition_variable done_cv;
+  const std::function< void(int, int, int) >* job = nullptr;
+  int job_size = 0;
+  long batch = 0;
+  int num_busy = 0;
+  bool stopping = false;
+  int num_threads;
+  void run(int n, const std::function< void(int thread, int begin, int end) >& body);
+  void run_range(int thread);
+  void work(int thread);
+
+  void find_min_levels(int begin, int end);
+  double water_level(int link, int thread);
+  void solve();
+  template <class Weight, class Rate>
+  void solve_flows(const int* flow_paths, const Weight* flow_weights,
+		   int num_flows, Rate* rates);
+
+ public:
+  // topology and paths have to outlive us, num_threads 0 is one per core
+  ApproxWaterfilling(const Topology& topology,
+		     PathTable& paths = PathTable::global(),
+		     int num_threads = 0);
+  ~ApproxWaterfilling();
+  ApproxWaterfilling(const ApproxWaterfilling&) = delete;
+  ApproxWaterfilling& operator=(const ApproxWaterfilling&) = delete;
+
+  // like WeightedWaterfilling::do_waterfilling
+  void do_waterfilling(const int* flow_paths, const double* flow_weights,
+		       int num_flows, double* rates);
+  void do_waterfilling(const int* flow_paths, const float* flow_weights,
+		       int num_flows, float* rates);
+
+  // stop once no level moves by more than epsilon in an iteration
+  void set_epsilon(double e) { epsilon = e; }
+  void set_max_iterations(int n) { max_iterations = n; }
+  int get_num_threads() const { return num_threads; }
+  long get_num_solves() const { return num_solves; }
+  long get_num_flows_solved() const { return num_flows_solved; }
+  long get_num_iterations() const { return num_iterations; }
+  int get_last_iterations() const { return last_iterations; }
+  double get_last_bottleneck_slack() const { return last_bottleneck_slack; }
+  // over all solves so far
+  double get_worst_bottleneck_slack() const { return worst_bottleneck_slack; }
+  // sums the sizes of every per solve array, only goes up
+  size_t capacity_held() const;
+  // bytes held by the per solve arrays
+  size_t memory_bytes() const;
+};
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <vector>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <algorithm>
+#include <type_traits>
+
+// Bump allocator for per-solve scratch. alloc() just moves a pointer,
+// reset() hands everything back at once. Memory is kept across resets,
+// so once the arena has grown to the biggest solve so far, solving
+// doesn't touch the heap at all. Only for trivially destructible types,
+// nothing allocated here is ever destroyed.
+class Arena {
+ protected:
+  std::vector< char* > chunks;
+  std::vector< size_t > chunk_sizes;
+  size_t chunk = 0; // chunk we're bumping in
+  size_t used = 0;  // bytes used in that chunk
+  size_t total = 0; // bytes held in all chunks
+  size_t num_mallocs = 0;
+
+  void* alloc_bytes(size_t bytes, size_t align) {
+    while (chunk < chunks.size()) {
+      size_t start = (used + align - 1) / align * align;
+      if (start + bytes <= chunk_sizes[chunk]) {
+	used = start + bytes;
+	return chunks[chunk] + start;
+      }
+      chunk++;
+      used = 0;
+    }
+    // at least double what we hold, so a solve needs few new chunks
+    size_t size = std::max(bytes + align, std::max(total, (size_t) 1 << 16));
+    char* mem = (char*) std::malloc(size);
+    if (not mem) {
+      std::cerr << "arena couldn't get " << size << " bytes\n";
+      exit(1);
+    }
+    chunks.push_back(mem);
+    chunk_sizes.push_back(size);
+    total += size;
+    num_mallocs++;
+    chunk = chunks.size() - 1;
+    used = 0;
+    return alloc_bytes(bytes, align);
+  }
+
+ public:
+  Arena() {}
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+  ~Arena() {
+    for (auto c : chunks) std::free(c);
+  }
+
+  // n uninitialized Ts
+  template <class T>
+  T* alloc(size_t n) {
+    static_assert(std::is_trivially_destructible<T>::value,
+		  "arena objects are never destroyed");
+    if (n == 0) n = 1;
+    return (T*) alloc_bytes(n * sizeof(T), alignof(T));
+  }
+
+  // n Ts set to value
+  template <class T>
+  T* alloc(size_t n, const T& value) {
+    T* p = alloc<T>(n);
+    std::fill(p, p + n, value);
+    return p;
+  }
+
+  // forget everything allocated so far, keep the memory.
+  // if the last round of allocations spilled into several chunks,
+  // merge them so the next one fits in one
+  void reset() {
+    if (chunks.size() > 1) {
+      for (auto c : chunks) std::free(c);
+      chunks.clear();
+      chunk_sizes.clear();
+      char* mem = (char*) std::malloc(total);
+      if (not mem) {
+	std::cerr << "arena couldn't get " << total << " bytes\n";
+	exit(1);
+      }
+      chunks.push_back(mem);
+      chunk_sizes.push_back(total);
+      num_mallocs++;
+    }
+    chunk = 0;
+    used = 0;
+  }
+
+  // bytes held, only grows
+  size_t capacity() const { return total; }
+  // times we went to the heap for a chunk
+  size_t get_num_mallocs() const { return num_mallocs; }
+};
+
+#endif
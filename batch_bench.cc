@@ -0,0 +1,64 @@
+#include "batch_waterfilling.h"
+#include "routing.h"
+#include <iostream>
+#include <chrono>
+#include <random>
+
+// solves random flow sets between the hosts (nodes with one link out)
+// of a topology with BatchWaterfilling, once on one thread and once on
+// num_threads, and reports solves per second
+int main(int argc, char** argv) {
+  if (argc != 5 and argc != 6) {
+    std::cerr << "Expected 4 or 5 arguments to binary- link file, num sets, flows per set, num threads, [seed]\n";
+    exit(1);
+  }
+  std::unique_ptr<Topology> topology = Topology::load(argv[1]);
+  int num_sets = atoi(argv[2]);
+  int flows_per_set = atoi(argv[3]);
+  int num_threads = atoi(argv[4]);
+  std::mt19937 rng(argc == 6 ? atoi(argv[5]) : 1);
+
+  std::vector< int > hosts;
+  for (int node = 0; node < topology->num_nodes(); node++) {
+    if (topology->out_end(node) - topology->out_begin(node) == 1) hosts.push_back(node);
+  }
+  if (hosts.size() < 2) {
+    std::cerr << "need at least 2 hosts (nodes with one link out)\n";
+    exit(1);
+  }
+
+  PathTable& paths = PathTable::global();
+  RouteTable routes(*topology, paths);
+  std::vector< int > set_begin(1, 0);
+  std::vector< int > flow_paths;
+  std::vector< double > flow_weights;
+  for (int s = 0; s < num_sets; s++) {
+    for (int f = 0; f < flows_per_set; f++) {
+      int src = hosts[rng() % hosts.size()];
+      int dst = hosts[rng() % hosts.size()];
+      flow_paths.push_back(src == dst ? -1 : routes.route(src, dst, rng()));
+      flow_weights.push_back(1);
+    }
+    set_begin.push_back(flow_paths.size());
+  }
+
+  std::vector< double > one_thread(flow_paths.size(), 0);
+  std::vector< double > many_threads(flow_paths.size(), 0);
+  for (int threads : {1, num_threads}) {
+    BatchWaterfilling batch(*topology, paths, threads);
+    std::vector< double >& rates = threads == 1 ? one_thread : many_threads;
+    // first pass warms up every thread's scratch
+    batch.solve(flow_paths.data(), flow_weights.data(), set_begin.data(), num_sets, rates.data());
+    auto start = std::chrono::steady_clock::now();
+    batch.solve(flow_paths.data(), flow_weights.data(), set_begin.data(), num_sets, rates.data());
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << batch.get_num_threads() << " threads: " << num_sets << " sets of "
+	      << flows_per_set << " flows in " << secs << " s, "
+	      << num_sets / secs << " solves per s" << std::endl;
+  }
+  if (one_thread != many_threads) {
+    std::cerr << "rates differ between 1 and " << num_threads << " threads\n";
+    exit(1);
+  }
+  return 0;
+}
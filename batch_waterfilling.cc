@@ -0,0 +1,96 @@
+#include "batch_waterfilling.h"
+#include <algorithm>
+
+// sets a thread takes at a time, small sets are cheap enough
+// that taking them one by one would make the counter the bottleneck
+static const int sets_per_grab = 8;
+
+BatchWaterfilling::BatchWaterfilling(const Topology& topology,
+				     PathTable& paths,
+				     int num_threads)
+  : topology(topology), paths(paths), next_set(0) {
+  if (num_threads <= 0) num_threads = std::max(1u, std::thread::hardware_concurrency());
+  for (int t = 0; t < num_threads; t++) {
+    solvers.emplace_back(new WeightedWaterfilling(topology, paths));
+    solvers.back()->set_incremental(true);
+  }
+  // the caller's thread is thread 0
+  for (int t = 1; t < num_threads; t++) {
+    workers.emplace_back(&BatchWaterfilling::work, this, t);
+  }
+}
+
+BatchWaterfilling::~BatchWaterfilling() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  start_cv.notify_all();
+  for (auto& w : workers) w.join();
+}
+
+void BatchWaterfilling::solve_sets(WeightedWaterfilling& wf) {
+  while (true) {
+    int first = next_set.fetch_add(sets_per_grab);
+    if (first >= num_sets) return;
+    int last = std::min(num_sets, first + sets_per_grab);
+    for (int s = first; s < last; s++) {
+      int begin = set_begin[s];
+      wf.do_waterfilling(flow_paths + begin, flow_weights + begin,
+			 set_begin[s + 1] - begin, rates + begin);
+    }
+  }
+}
+
+void BatchWaterfilling::work(int thread) {
+  long seen = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      start_cv.wait(lock, [&] { return stopping or batch != seen; });
+      if (stopping) return;
+      seen = batch;
+    }
+    solve_sets(*solvers[thread]);
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      num_busy--;
+    }
+    done_cv.notify_one();
+  }
+}
+
+void BatchWaterfilling::solve(const int* flow_paths, const double* flow_weights,
+			      const int* set_begin, int num_sets, double* rates) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    this->flow_paths = flow_paths;
+    this->flow_weights = flow_weights;
+    this->set_begin = set_begin;
+    this->num_sets = num_sets;
+    this->rates = rates;
+    next_set.store(0);
+    num_busy = workers.size();
+    batch++;
+  }
+  start_cv.notify_all();
+  solve_sets(*solvers[0]);
+  std::unique_lock<std::mutex> lock(mutex);
+  done_cv.wait(lock, [&] { return num_busy == 0; });
+}
+
+void BatchWaterfilling::set_incremental(bool on) {
+  for (auto& wf : solvers) wf->set_incremental(on);
+}
+
+long BatchWaterfilling::get_num_flows_solved() const {
+  long n = 0;
+  for (auto& wf : solvers) n += wf->get_num_flows_solved();
+  return n;
+}
+
+long BatchWaterfilling::get_num_entities_solved() const {
+  long n = 0;
+  for (auto& wf : solvers) n += wf->get_num_entities_solved();
+  return n;
+}
@@ -0,0 +1,71 @@
+#ifndef BATCH_WATERFILLING_H
+#define BATCH_WATERFILLING_H
+
+#include "weighted_waterfilling.h"
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Solves many small independent flow sets on one topology, spread over a
+// pool of threads. Each thread keeps its own WeightedWaterfilling, so its
+// arena and path link ids are reused from one set to the next and the
+// threads share nothing but the read-only topology and path table. Sets
+// are handed out a few at a time from an atomic counter, so uneven sets
+// balance out. Meant for throughput, one big set is better off with
+// WeightedWaterfilling directly.
+class BatchWaterfilling {
+ protected:
+  const Topology& topology;
+  PathTable& paths;
+  std::vector< std::unique_ptr<WeightedWaterfilling> > solvers; // one per thread
+  std::vector< std::thread > workers; // all threads but the caller's
+
+  // the batch being solved
+  const int* flow_paths = nullptr;
+  const double* flow_weights = nullptr;
+  const int* set_begin = nullptr;
+  int num_sets = 0;
+  double* rates = nullptr;
+  std::atomic< int > next_set;
+
+  std::mutex mutex;
+  std::condition_variable start_cv;
+  std::condition_variable done_cv;
+  long batch = 0; // counts batches, workers wait for the next one
+  int num_busy = 0; // workers still on this batch
+  bool stopping = false;
+
+  void work(int thread);
+  void solve_sets(WeightedWaterfilling& wf);
+
+ public:
+  // topology and paths have to outlive us, num_threads 0 is one per core
+  BatchWaterfilling(const Topology& topology,
+		    PathTable& paths = PathTable::global(),
+		    int num_threads = 0);
+  ~BatchWaterfilling();
+  BatchWaterfilling(const BatchWaterfilling&) = delete;
+  BatchWaterfilling& operator=(const BatchWaterfilling&) = delete;
+
+  // set s is flows set_begin[s] .. set_begin[s+1]-1 of the flat arrays,
+  // flow_paths[f] is a path id (interned beforehand, the path table
+  // mustn't change during the call) or -1 for no flow. each set is
+  // solved on its own and rates[f] set like WeightedWaterfilling does.
+  // returns once all sets are solved
+  void solve(const int* flow_paths, const double* flow_weights,
+	     const int* set_begin, int num_sets, double* rates);
+
+  // solves incrementally by default (see WaterfillingSolver), which is
+  // much faster on bigger sets but can differ from WeightedWaterfilling's
+  // default rates in the last bits. false gives the same bits
+  void set_incremental(bool on);
+  int get_num_threads() const { return solvers.size(); }
+  // flows and solver entities summed over all threads and solves
+  long get_num_flows_solved() const;
+  long get_num_entities_solved() const;
+};
+
+#endif
@@ -0,0 +1,164 @@
+#include "bottleneck_stats.h"
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <algorithm>
+
+// how close to full a link and to the top level a flow have to be
+static const double bottleneck_tolerance = 1e-6;
+
+BottleneckStats::BottleneckStats(const Topology& topology, const PathTable& paths,
+				 const std::string& filename)
+  : topology(topology), paths(paths), out(filename) {
+  if (not out.is_open()) {
+    std::cerr << "Unable to open file " << filename << std::endl;
+    exit(1);
+  }
+  int num_links = topology.num_links();
+  num_bottlenecked.assign(num_links, 0);
+  integrated_to.assign(num_links, 0);
+  binding_time.assign(num_links, 0);
+  flow_time.assign(num_links, 0);
+  max_flows.assign(num_links, 0);
+  num_flows.assign(num_links, 0);
+  load.assign(num_links, 0);
+  max_level.assign(num_links, -1);
+}
+
+void BottleneckStats::integrate(int link, double time) {
+  double dt = time - integrated_to[link];
+  if (dt > 0 and num_bottlenecked[link] > 0) {
+    binding_time[link] += dt;
+    flow_time[link] += num_bottlenecked[link] * dt;
+  }
+  integrated_to[link] = time;
+}
+
+void BottleneckStats::set_hop(int slot, int new_hop, double time) {
+  int old_hop = hop[slot];
+  const int* links = path_links.begin(path[slot]);
+  if (old_hop >= 0) {
+    double dt = time - since[slot];
+    hop_time[slot][old_hop] += dt;
+    int last = path_links.size(path[slot]) - 1;
+    position_time[old_hop == 0 ? 0 : old_hop == last ? 2 : 1] += dt;
+  }
+  since[slot] = time;
+  if (new_hop == old_hop) return;
+  if (old_hop >= 0) {
+    integrate(links[old_hop], time);
+    num_bottlenecked[links[old_hop]]--;
+  }
+  if (new_hop >= 0) {
+    int link = links[new_hop];
+    integrate(link, time);
+    num_bottlenecked[link]++;
+    max_flows[link] = std::max(max_flows[link], num_bottlenecked[link]);
+  }
+  hop[slot] = new_hop;
+}
+
+void BottleneckStats::add_flow(int slot, int flow_path, double time) {
+  if (start < 0) start = time;
+  path_links.update(paths, topology);
+  if (slot >= (int) path.size()) {
+    path.resize(slot + 1, -1);
+    hop.resize(slot + 1, -1);
+    since.resize(slot + 1, 0);
+    hop_time.resize(slot + 1);
+  }
+  path[slot] = flow_path;
+  hop[slot] = -1;
+  since[slot] = time;
+  hop_time[slot].assign(path_links.size(flow_path), 0);
+}
+
+void BottleneckStats::update(const FlowTable& flows, double time) {
+  // every link's load and the top level of its flows
+  for (int slot = 0; slot < flows.num_slots(); slot++) {
+    if (not flows.in_use(slot)) continue;
+    double rate = flows.rate[slot];
+    double level = rate / flows.weight[slot];
+    int p = flows.path[slot];
+    for (const int* l = path_links.begin(p); l != path_links.end(p); l++) {
+      if (max_level[*l] < 0) touched.push_back(*l);
+      load[*l] += rate;
+      max_level[*l] = std::max(max_level[*l], level);
+    }
+  }
+  for (int slot = 0; slot < flows.num_slots(); slot++) {
+    if (not flows.in_use(slot)) continue;
+    double level = flows.rate[slot] / flows.weight[slot];
+    int p = flows.path[slot];
+    const int* links = path_links.begin(p);
+    int n = path_links.size(p);
+    int bottleneck = -1;
+    int fullest = 0;
+    for (int h = 0; h < n; h++) {
+      int l = links[h];
+      double cap = topology.capacity(l);
+      if (load[l] / cap > load[links[fullest]] / topology.capacity(links[fullest])) fullest = h;
+      if (load[l] >= cap * (1 - bottleneck_tolerance)
+	  and level >= max_level[l] * (1 - bottleneck_tolerance)) {
+	bottleneck = h;
+	break;
+      }
+    }
+    set_hop(slot, bottleneck >= 0 ? bottleneck : fullest, time);
+  }
+  for (int l : touched) {
+    load[l] = 0;
+    max_level[l] = -1;
+  }
+  touched.clear();
+}
+
+int BottleneckStats::remove_flow(int slot, double time) {
+  if (slot >= (int) path.size() or path[slot] < 0) return -1;
+  set_hop(slot, -1, time);
+  const int* links = path_links.begin(path[slot]);
+  const std::vector< double >& times = hop_time[slot];
+  int longest = -1;
+  for (int h = 0; h < (int) times.size(); h++) {
+    if (times[h] <= 0) continue;
+    num_flows[links[h]]++;
+    if (longest < 0 or times[h] > times[longest]) longest = h;
+  }
+  path[slot] = -1;
+  return longest >= 0 ? links[longest] : -1;
+}
+
+void BottleneckStats::write_report(double time) {
+  // flows still running count up to time
+  for (int slot = 0; slot < (int) path.size(); slot++) {
+    if (path[slot] < 0 or hop[slot] < 0) continue;
+    set_hop(slot, hop[slot], time);
+    const int* links = path_links.begin(path[slot]);
+    for (int h = 0; h < (int) hop_time[slot].size(); h++) {
+      if (hop_time[slot][h] > 0 or h == hop[slot]) num_flows[links[h]]++;
+    }
+  }
+  double length = start >= 0 ? time - start : 0;
+  out << "link,src,dst,capacity,binding_time,binding_share,flows,mean_flows,max_flows\n";
+  out.precision(9);
+  for (int link = 0; link < topology.num_links(); link++) {
+    integrate(link, time);
+    if (max_flows[link] == 0) continue;
+    link_t ends = topology.get_link(link);
+    out << link << "," << ends.first << "," << ends.second << ","
+	<< topology.capacity(link) << "," << binding_time[link] << ","
+	<< (length > 0 ? binding_time[link] / length : 0) << ","
+	<< num_flows[link] << ","
+	<< (binding_time[link] > 0 ? flow_time[link] / binding_time[link] : 0) << ","
+	<< max_flows[link] << "\n";
+  }
+  out.flush();
+}
+
+void BottleneckStats::write_summary(std::ostream& out) const {
+  double total = position_time[0] + position_time[1] + position_time[2];
+  if (total <= 0) return;
+  out << std::setprecision(3) << "flows bottlenecked " << 100 * position_time[0] / total << "% of the time on their first hop, "
+      << 100 * position_time[1] / total << "% in between, "
+      << 100 * position_time[2] / total << "% on their last hop\n";
+}
@@ -0,0 +1,76 @@
+#ifndef BOTTLENECK_STATS_H
+#define BOTTLENECK_STATS_H
+
+#include "waterfilling_solver.h"
+#include "flow_table.h"
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Which link limits each flow, and for how long. After every solve a
+// flow's bottleneck is the first link on its path that is full and
+// where no flow has a higher level (rate per unit weight), the link the
+// waterfilling round saturated it on. It's read off the rates rather
+// than the solver's rounds so it's the same with every solver (tree,
+// warm starts, memo hits, approximate solves). An approximate solve
+// may leave no link quite full, then the fullest link on the path is
+// taken. Bottlenecks hold between solves like the rates do.
+//
+// By link this keeps the time it bottlenecked at least one flow, how
+// many distinct flows it bottlenecked and the time-weighted mean and
+// max of how many at once. By flow it keeps the time on each hop of its
+// path, remove_flow() hands back the link it spent longest on.
+class BottleneckStats {
+ protected:
+  const Topology& topology;
+  const PathTable& paths;
+  PathLinkIds path_links;
+  std::ofstream out;
+
+  // by flow table slot
+  std::vector< int > path; // -1 if not in use
+  std::vector< int > hop; // index on the path of the bottleneck, -1 before a solve
+  std::vector< double > since; // time the bottleneck was picked
+  std::vector< std::vector< double > > hop_time; // time on each hop
+
+  // by topology link
+  std::vector< int > num_bottlenecked; // flows right now
+  std::vector< double > integrated_to;
+  std::vector< double > binding_time;
+  std::vector< double > flow_time; // flows * s
+  std::vector< int > max_flows;
+  std::vector< long > num_flows; // distinct flows bottlenecked
+  // scratch for update()
+  std::vector< double > load;
+  std::vector< double > max_level;
+  std::vector< int > touched;
+
+  // flow time bottlenecked on the first hop, in between and on the last
+  double position_time[3] = {0, 0, 0};
+  double start = -1;
+
+  void integrate(int link, double time);
+  void set_hop(int slot, int new_hop, double time);
+
+ public:
+  // the report goes to filename
+  BottleneckStats(const Topology& topology, const PathTable& paths,
+		  const std::string& filename);
+
+  void add_flow(int slot, int path, double time);
+  // picks every flow's bottleneck from the rates just solved
+  void update(const FlowTable& flows, double time);
+  // topology link id the flow was bottlenecked on longest, -1 if none
+  int remove_flow(int slot, double time);
+
+  // one CSV row per link that was ever a bottleneck, through time:
+  //   link,src,dst,capacity,binding_time,binding_share,flows,mean_flows,max_flows
+  // mean_flows is over the binding time
+  void write_report(double time);
+  // share of flow time bottlenecked on the first hop of its path (a
+  // host uplink on a tree), in between and on the last
+  void write_summary(std::ostream& out) const;
+};
+
+#endif
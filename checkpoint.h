@@ -0,0 +1,54 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// Raw reads and writes for simulator checkpoints (--checkpoint, see
+// README.txt). Values go out in the host's layout like a topology
+// snapshot, so a checkpoint is read back by the same build on the same
+// kind of machine. Readers check in.good() once at the end.
+static const char checkpoint_magic[8] = {'W', 'F', 'C', 'K', 'P', 'T', '1', '\0'};
+
+template <class T>
+void checkpoint_put(std::ostream& out, const T& value) {
+  out.write((const char*) &value, sizeof(T));
+}
+
+template <class T>
+void checkpoint_get(std::istream& in, T& value) {
+  in.read((char*) &value, sizeof(T));
+}
+
+template <class T>
+void checkpoint_put(std::ostream& out, const std::vector< T >& values) {
+  uint64_t n = values.size();
+  checkpoint_put(out, n);
+  out.write((const char*) values.data(), n * sizeof(T));
+}
+
+template <class T>
+void checkpoint_get(std::istream& in, std::vector< T >& values) {
+  uint64_t n = 0;
+  checkpoint_get(in, n);
+  values.resize(n);
+  in.read((char*) values.data(), n * sizeof(T));
+}
+
+inline void checkpoint_put(std::ostream& out, const std::string& s) {
+  uint64_t n = s.size();
+  checkpoint_put(out, n);
+  out.write(s.data(), n);
+}
+
+inline void checkpoint_get(std::istream& in, std::string& s) {
+  uint64_t n = 0;
+  checkpoint_get(in, n);
+  s.resize(n);
+  in.read(&s[0], n);
+}
+
+#endif
@@ -0,0 +1,19 @@
+#include "topology.h"
+#include <iostream>
+
+// compiles a text link file into a binary topology snapshot that the
+// simulators can mmap instead of parsing, pass it in place of the link file
+int main(int argc, char** argv) {
+  if (argc != 3) {
+    std::cerr << "Expected 2 arguments to binary- link file, snapshot file\n";
+    exit(1);
+  }
+  std::unique_ptr<Topology> topology = Topology::from_link_file(argv[1]);
+  if (not topology->write_snapshot(argv[2])) {
+    std::cerr << "couldn't write snapshot " << argv[2] << std::endl;
+    exit(1);
+  }
+  std::cout << "wrote " << topology->num_links() << " links between "
+	    << topology->num_nodes() << " nodes to " << argv[2] << std::endl;
+  return 0;
+}
@@ -0,0 +1,90 @@
+#include "fct_stats.h"
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+
+static const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+
+FctStats::FctStats(const Topology& topology, const PathTable& paths)
+  : topology(topology), paths(paths) {}
+
+double FctStats::path_capacity(int path) {
+  if (path >= (int) min_capacity.size()) min_capacity.resize(paths.num_paths(), 0);
+  double& cap = min_capacity[path];
+  if (cap == 0) {
+    cap = std::numeric_limits<double>::infinity();
+    for (const link_t* l = paths.begin(path); l != paths.end(path); l++) {
+      cap = std::min(cap, topology.capacity(topology.link_id(*l)));
+    }
+  }
+  return cap;
+}
+
+void FctStats::add_to(Bucket& bucket, double fct, double slowdown) {
+  bucket.num_flows++;
+  bucket.sum_fct += fct;
+  bucket.sum_slowdown += slowdown;
+  bucket.fct.add(fct);
+  bucket.slowdown.add(slowdown);
+}
+
+void FctStats::add(int path, double bytes, double fct) {
+  // capacities are in Gb/s
+  double alone = bytes * 8 / (path_capacity(path) * 1e9);
+  double slowdown = alone > 0 ? fct / alone : 1;
+  int decade = bytes >= 1 ? (int) std::floor(std::log10(bytes)) : 0;
+  add_to(by_size[decade], fct, slowdown);
+  add_to(all, fct, slowdown);
+}
+
+void FctStats::write_summary(std::ostream& out) {
+  out << "slowdown and fct (s) by flow size, mean p50 p90 p99 p99.9 max\n";
+  auto line = [&](const Bucket& b) {
+    out << b.num_flows << " flows, slowdown " << std::setprecision(4)
+	<< b.sum_slowdown / b.num_flows;
+    for (double q : quantiles) out << " " << b.slowdown.quantile(q);
+    out << " " << b.slowdown.max() << ", fct " << b.sum_fct / b.num_flows;
+    for (double q : quantiles) out << " " << b.fct.quantile(q);
+    out << " " << b.fct.max() << "\n";
+  };
+  for (auto& sb : by_size) {
+    out << "  1e" << sb.first << " to 1e" << sb.first + 1 << " bytes: ";
+    line(sb.second);
+  }
+  if (all.num_flows > 0) {
+    out << "  all: ";
+    line(all);
+  }
+}
+
+void FctStats::write_csv(const std::string& filename) {
+  std::ofstream out(filename);
+  if (not out.is_open()) {
+    std::cerr << "Unable to open file " << filename << std::endl;
+    exit(1);
+  }
+  out << "from,to,metric,flows,mean,p50,p90,p99,p999,max\n";
+  out.precision(9);
+  auto rows = [&](double from, double to, const Bucket& b) {
+    out << from << "," << to << ",slowdown," << b.num_flows << ","
+	<< b.sum_slowdown / b.num_flows;
+    for (double q : quantiles) out << "," << b.slowdown.quantile(q);
+    out << "," << b.slowdown.max() << "\n";
+    out << from << "," << to << ",fct," << b.num_flows << "," << b.sum_fct / b.num_flows;
+    for (double q : quantiles) out << "," << b.fct.quantile(q);
+    out << "," << b.fct.max() << "\n";
+  };
+  for (auto& sb : by_size) {
+    rows(std::pow(10.0, sb.first), std::pow(10.0, sb.first + 1), sb.second);
+  }
+  if (all.num_flows > 0) rows(0, std::numeric_limits<double>::infinity(), all);
+}
+
+size_t FctStats::capacity_held() const {
+  size_t held = min_capacity.capacity() + all.fct.capacity_held() + all.slowdown.capacity_held();
+  for (auto& sb : by_size) held += 1 + sb.second.fct.capacity_held() + sb.second.slowdown.capacity_held();
+  return held;
+}
@@ -0,0 +1,53 @@
+#ifndef FCT_STATS_H
+#define FCT_STATS_H
+
+#include "topology.h"
+#include "path_table.h"
+#include "kll_sketch.h"
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// FCTs and slowdowns summarised as flows finish, instead of from the fct
+// lines afterwards. A flow's slowdown is its fct over the time it would
+// take alone, its bytes at the smallest capacity on its path. Flows are
+// bucketed by size in decades (1e3 to 1e4 bytes, ...) and each bucket,
+// and all flows together, keep exact means and maxima and KLL sketches
+// (kll_sketch.h) for the quantiles, so memory doesn't grow with the
+// number of flows.
+class FctStats {
+ protected:
+  struct Bucket {
+    long num_flows = 0;
+    double sum_fct = 0;
+    double sum_slowdown = 0;
+    KllSketch fct;
+    KllSketch slowdown;
+  };
+  const Topology& topology;
+  const PathTable& paths;
+  std::vector< double > min_capacity; // by path id, 0 until looked up
+  std::map< int, Bucket > by_size; // by floor(log10(bytes))
+  Bucket all;
+
+  double path_capacity(int path);
+  void add_to(Bucket& bucket, double fct, double slowdown);
+
+ public:
+  FctStats(const Topology& topology, const PathTable& paths);
+
+  // a flow of bytes on path finished in fct seconds
+  void add(int path, double bytes, double fct);
+  // a line per bucket with the mean, p50, p90, p99, p99.9 and max of
+  // slowdown and fct
+  void write_summary(std::ostream& out);
+  // the same as CSV rows, bytes from/to of the bucket (0 and inf for
+  // all flows):
+  //   from,to,metric,flows,mean,p50,p90,p99,p999,max
+  void write_csv(const std::string& filename);
+  // sums the sizes of every bucket and sketch, only goes up
+  size_t capacity_held() const;
+};
+
+#endif
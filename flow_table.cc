@@ -0,0 +1,160 @@
+#include "flow_table.h"
+#include "checkpoint.h"
+#include <iostream>
+#include <cstdlib>
+
+FlowTable::FlowTable() {
+  hash_slots.assign(64, -1);
+  hash_mask = 63;
+}
+
+void FlowTable::grow_hash() {
+  std::vector< int > old_slots;
+  old_slots.swap(hash_slots);
+  hash_slots.assign(old_slots.size() * 2, -1);
+  hash_mask = hash_slots.size() - 1;
+  for (size_t i = 0; i < old_slots.size(); i++) {
+    if (old_slots[i] >= 0) hash_insert(flow_id[old_slots[i]], old_slots[i]);
+  }
+}
+
+// grow by an eighth rather than doubling, at millions of flows the
+// slack a doubling vector leaves would be most of the table
+void FlowTable::grow_slots() {
+  size_t slots = flow_id.capacity() + flow_id.capacity() / 8 + 64;
+  flow_id.reserve(slots);
+  path.reserve(slots);
+  weight.reserve(slots);
+  bytes_left.reserve(slots);
+  rate.reserve(slots);
+  start.reserve(slots);
+  size.reserve(slots);
+  // every slot can end up on the free list, make room now so
+  // remove() never reallocates
+  free_slots.reserve(slots);
+}
+
+void FlowTable::hash_insert(int flow, int slot) {
+  size_t i = hash_of(flow);
+  while (hash_slots[i] >= 0) i = (i + 1) & hash_mask;
+  hash_slots[i] = slot;
+}
+
+void FlowTable::hash_erase(int flow) {
+  size_t i = hash_of(flow);
+  while (hash_slots[i] < 0 or flow_id[hash_slots[i]] != flow) {
+    if (hash_slots[i] < 0) return;
+    i = (i + 1) & hash_mask;
+  }
+  // backward shift deletion, no tombstones
+  size_t j = i;
+  while (true) {
+    j = (j + 1) & hash_mask;
+    if (hash_slots[j] < 0) break;
+    size_t home = hash_of(flow_id[hash_slots[j]]);
+    // move j back to i unless its home lies cyclically in (i, j]
+    bool stays = (i <= j) ? (i < home and home <= j) : (i < home or home <= j);
+    if (stays) continue;
+    hash_slots[i] = hash_slots[j];
+    i = j;
+  }
+  hash_slots[i] = -1;
+}
+
+int FlowTable::find(int flow) const {
+  if (flow < 0) return -1;
+  size_t i = hash_of(flow);
+  while (hash_slots[i] >= 0) {
+    if (flow_id[hash_slots[i]] == flow) return hash_slots[i];
+    i = (i + 1) & hash_mask;
+  }
+  return -1;
+}
+
+int FlowTable::add(int flow) {
+  if (flow < 0 or find(flow) >= 0) {
+    std::cerr << "can't add flow " << flow << " to flow table\n";
+    exit(1);
+  }
+  int slot;
+  if (free_slots.size() > 0) {
+    slot = free_slots.back();
+    free_slots.pop_back();
+  } else {
+    if (flow_id.size() == flow_id.capacity()) grow_slots();
+    slot = flow_id.size();
+    flow_id.push_back(-1);
+    path.push_back(-1);
+    weight.push_back(0);
+    bytes_left.push_back(0);
+    rate.push_back(0);
+    start.push_back(0);
+    size.push_back(0);
+  }
+  flow_id[slot] = flow;
+  num_active_++;
+  // keep the load factor under 0.7
+  if (10 * (size_t) num_active_ > 7 * hash_slots.size()) grow_hash();
+  hash_insert(flow, slot);
+  return slot;
+}
+
+void FlowTable::remove(int slot) {
+  if (slot < 0 or slot >= num_slots() or not in_use(slot)) {
+    std::cerr << "can't remove slot " << slot << " from flow table\n";
+    exit(1);
+  }
+  hash_erase(flow_id[slot]);
+  flow_id[slot] = -1;
+  path[slot] = -1;
+  rate[slot] = 0;
+  num_active_--;
+  free_slots.push_back(slot);
+}
+
+size_t FlowTable::memory_bytes() const {
+  return flow_id.capacity() * sizeof(int)
+    + path.capacity() * sizeof(int)
+    + weight.capacity() * sizeof(weight_t)
+    + bytes_left.capacity() * sizeof(double)
+    + rate.capacity() * sizeof(rate_t)
+    + start.capacity() * sizeof(double)
+    + size.capacity() * sizeof(double)
+    + free_slots.capacity() * sizeof(int)
+    + hash_slots.capacity() * sizeof(int);
+}
+
+void FlowTable::save(std::ostream& out) const {
+  checkpoint_put(out, flow_id);
+  checkpoint_put(out, path);
+  checkpoint_put(out, weight);
+  checkpoint_put(out, bytes_left);
+  checkpoint_put(out, rate);
+  checkpoint_put(out, start);
+  checkpoint_put(out, size);
+  checkpoint_put(out, free_slots);
+}
+
+void FlowTable::restore(std::istream& in) {
+  checkpoint_get(in, flow_id);
+  checkpoint_get(in, path);
+  checkpoint_get(in, weight);
+  checkpoint_get(in, bytes_left);
+  checkpoint_get(in, rate);
+  checkpoint_get(in, start);
+  checkpoint_get(in, size);
+  checkpoint_get(in, free_slots);
+  free_slots.reserve(flow_id.size());
+  num_active_ = 0;
+  for (int slot = 0; slot < num_slots(); slot++) {
+    if (in_use(slot)) num_active_++;
+  }
+  hash_slots.assign(64, -1);
+  while (10 * (size_t) num_active_ > 7 * hash_slots.size()) {
+    hash_slots.assign(hash_slots.size() * 2, -1);
+  }
+  hash_mask = hash_slots.size() - 1;
+  for (int slot = 0; slot < num_slots(); slot++) {
+    if (in_use(slot)) hash_insert(flow_id[slot], slot);
+  }
+}
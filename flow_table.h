@@ -0,0 +1,71 @@
+#ifndef FLOW_TABLE_H
+#define FLOW_TABLE_H
+
+#include <vector>
+#include <cstddef>
+#include <iosfwd>
+
+// -DWF_COMPACT keeps weights and rates as float32 (relative error under
+// 6e-8, weights are small integers and stay exact). bytes left stay
+// double, a flow is done when they get within 1e-3 bytes of 0
+#ifdef WF_COMPACT
+typedef float weight_t;
+typedef float rate_t;
+#else
+typedef double weight_t;
+typedef double rate_t;
+#endif
+
+// Per-flow state of the active flows, one field per array, all indexed by
+// a dense slot. Arriving flows take a slot off the free list and give it
+// back when they finish, so slots stay packed below the peak number of
+// active flows and a pass over the active flows is a scan over contiguous
+// memory. Flow ids are only looked up (in a small open addressing table)
+// where the trace names a flow. Flow and path ids are 32 bit.
+class FlowTable {
+ public:
+  // per slot, flow_id is -1 and path is -1 when the slot is free
+  std::vector< int > flow_id;
+  std::vector< int > path; // path id in the path table
+  std::vector< weight_t > weight;
+  std::vector< double > bytes_left;
+  std::vector< rate_t > rate; // in Gb/s
+  std::vector< double > start;
+  std::vector< double > size; // bytes when the flow started
+
+ protected:
+  std::vector< int > free_slots;
+  int num_active_ = 0;
+
+  // flow id -> slot, linear probing, -1 is empty. only slots are
+  // stored, an entry's flow id is flow_id[slot]
+  std::vector< int > hash_slots;
+  size_t hash_mask = 0;
+
+  size_t hash_of(int flow) const { return ((unsigned) flow * 2654435761u) & hash_mask; }
+  void hash_insert(int flow, int slot);
+  void hash_erase(int flow);
+  void grow_hash();
+  void grow_slots();
+
+ public:
+  FlowTable();
+  // slot for a new flow, flow must not be active already
+  int add(int flow);
+  void remove(int slot);
+  // slot of an active flow, -1 if it isn't active
+  int find(int flow) const;
+
+  bool in_use(int slot) const { return flow_id[slot] >= 0; }
+  // every in use slot is below num_slots()
+  int num_slots() const { return flow_id.size(); }
+  int num_active() const { return num_active_; }
+  // bytes held by all the arrays
+  size_t memory_bytes() const;
+  // every array and the free list, a restored table has the same slots
+  // (checkpoint.h). restore() replaces what's there
+  void save(std::ostream& out) const;
+  void restore(std::istream& in);
+};
+
+#endif
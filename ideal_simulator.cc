@@ -1,95 +1,69 @@
 #include "ideal_simulator.h"
+#include "checkpoint.h"
 #include <sstream>
 #include <string>
 #include <iostream>
 #include <memory>
 #include <cmath>
 #include <iomanip> 
+#include <algorithm>
+#include <cctype>
 IdealSimulator::IdealSimulator(const std::string& flow_filename, 
 				 const std::string& out_filename,
 			       const std::string& link_filename,
 			       double min_bytes_for_priority,
 			       double priority_weight,
-			       double max_sim_time):
-  flow_filename(flow_filename), out_filename(out_filename), link_filename(link_filename),
-  flow_file(flow_filename), out_file(out_filename),
-  min_bytes_for_priority_(min_bytes_for_priority), priority_weight_(priority_weight),
-  max_sim_time_(max_sim_time) {
-
-if (not flow_file.is_open()) {
-    std::cerr << "Unable to open file " << flow_filename << std::endl;
-   exit(1);
+			       double max_sim_time,
+			       const std::string& restore_from):
+  TraceSimulator(flow_filename, out_filename, link_filename, min_bytes_for_priority,
+		 priority_weight, max_sim_time, not restore_from.empty()) {
+ if (not restore_from.empty()) restore(restore_from);
 }
 
-if (not out_file.is_open()) {
-    std::cerr << "Unable to open file " << out_filename << std::endl;
-   exit(1);
-}
 
-if (max_sim_time_ <= 0) {
-  std::cerr << "invalid max_sim_time " << max_sim_time_ << std::endl;
-  exit(1);
+// start of the next whitespace separated token at or after p, moves p
+// past it, nullptr once the line is used up. tokens are read in place
+// with atoi/atof, which stop at the whitespace after them
+static const char* next_token(const char*& p) {
+  while (*p != '\0' and std::isspace((unsigned char) *p)) p++;
+  if (*p == '\0') return nullptr;
+  const char* token = p;
+  while (*p != '\0' and not std::isspace((unsigned char) *p)) p++;
+  return token;
 }
 
-// parse link filename and initialize wf
- std::ifstream link_file(link_filename);
-if (not link_file.is_open()) {
-    std::cerr << "Unable to open file " << link_filename << std::endl;
-   exit(1);
-}
-std::string line;
-std::map<link_t, double > link_capacities;
-while (getline (link_file,line)) {
-std::string buf1;
-std::string buf2;
-std::string buf3;
- std::stringstream ss(line);
-if (ss >> buf1 and ss >> buf2 and ss >> buf3) {
-  int node1 = atoi(buf1.c_str());
-  int node2 = atoi(buf2.c_str());
-  double cap = atof(buf3.c_str());
- link_capacities[std::make_pair(node1, node2)] = cap;
-} else {
-std::cerr << "can't parse " << line << " to get link and cap\n";
-}
-}
-
-std::cout << "set up " << link_capacities.size() << " links.\n";
- wf = std::make_unique<WeightedWaterfilling>(link_capacities);
-}
+bool IdealSimulator::parse_line(const std::string& line) {
+const char* p = line.c_str();
+const char* buf;
 
-
-bool IdealSimulator::parse_line(const std::string line) {
-std::string buf; // Have a buffer string
-std::stringstream ss(line); // Insert the string into a stream
-
-if (ss >> buf) {
-    next_flow = atoi(buf.c_str());
+if ((buf = next_token(p))) {
+    next_flow = atoi(buf);
 } else {
     std::cerr << "couldn't get flow id from " << line << "\n";
     exit(1);
 }
 
 
-if (ss >> buf) {
-next_num_bytes = atoi(buf.c_str());
+if ((buf = next_token(p))) {
+next_num_bytes = atoi(buf);
 } else {
 std::cerr << "couldn't get num_bytes from " << line << "\n";
 exit(1);
 }
 
-if (ss >> buf) {
-next_start = atof(buf.c_str());
+if ((buf = next_token(p))) {
+next_start = atof(buf) + trace_time_offset;
 } else {
 std::cerr << "couldn't get start from " << line << "\n";
 exit(1);
 }
 
+path_buf.clear();
 int prev_node = -1;
-while (ss >> buf) {
-int node = atoi(buf.c_str());
+while ((buf = next_token(p))) {
+int node = atoi(buf);
 if (prev_node >= 0) {
-next_path.push_back(std::make_pair(prev_node, node));
+path_buf.push_back(std::make_pair(prev_node, node));
 }
 prev_node = node;
 } 
@@ -98,56 +72,76 @@ if (prev_node == -1) {
 std::cerr << "couldn't get path from " << line << "\n";
 exit(1);
 }
+if (path_buf.size() == 1) {
+  // only src and dst given, route it on the topology
+  next_path = engine->route(path_buf.front().first, path_buf.front().second, next_flow);
+  if (next_path < 0) {
+    std::cerr << "no route for " << line << "\n";
+    exit(1);
+  }
+} else {
+  next_path = paths.intern(path_buf);
+}
 
 std::cout << "parsed line " << line
 << " to get flow_id " << next_flow
 << ", start_time " << next_start
 << ", num_bytes " << next_num_bytes
 << " and path ";
-for (auto l : next_path) {
-std::cout << l.first << "->" << l.second << " ";
+for (const link_t* l = paths.begin(next_path); l != paths.end(next_path); l++) {
+std::cout << l->first << "->" << l->second << " ";
 }
 std::cout << std::endl;
 return true;
 }
 
-IdealSimulator::~IdealSimulator() {
-if (flow_file.is_open()) {
-  flow_file.close();   
-}
- if (out_file.is_open()) {
-   out_file.close();
- }
-}
 bool IdealSimulator::get_next_flow() {
   std::cout << "get_next_flow\n";
   // reset
   next_start= -1;
   next_flow = -1;
   next_num_bytes = -1;
-  next_path.clear();
+  next_path = -1;
 
   if (not flow_file.is_open()) {
     std::cerr << "Unable to open file " << flow_filename << std::endl;
     exit(1);
   }
-  std::string line;
   if (getline (flow_file,line)) {parse_line(line); return true;}       
   return false;
 }
 
+
+
+#ifdef WF_COUNT_ALLOCS
+size_t IdealSimulator::scratch_high_water() {
+  return TraceSimulator::scratch_high_water() + arrival_wait.capacity();
+}
+
+void IdealSimulator::rewind_trace() {
+  next_start = -1;
+  next_flow = -1;
+  next_path = -1;
+  next_num_bytes = -1;
+}
+#endif
+
 void IdealSimulator::log_rates() {
+     const FlowTable& flows = engine->get_flows();
+     double curr_time = engine->get_time();
      std::cout << "at time " << curr_time << " " 
-	       << active_flow_paths.size() << " active flows total \n";
+	       << flows.num_active() << " active flows total \n";
      int af_uplink_0 = 0;
-     for (auto f : rates) {
-       int src = active_flow_paths.at(f.first).front().first;
+     for (int slot = 0; slot < flows.num_slots(); slot++) {
+       if (not flows.in_use(slot)) continue;
+       int path = flows.path[slot];
+       int src = paths.front(path).first;
        std::cout << "at time " << curr_time << " rate of flow " 
-		 << f.first << " is " << f.second 
-		 << " bytes " << active_flow_bytes.at(f.first) 
-		 << " out of " << flow_bytes.at(f.first)
+		 << flows.flow_id[slot] << " is " << flows.rate[slot]
+		 << " bytes " << flows.bytes_left[slot]
+		 << " out of " << flows.size[slot]
 		 << " gid " << src
-		 << "-" << active_flow_paths.at(f.first).back().second
+		 << "-" << paths.back(path).second
 		 << "\n";
        if (src == 0) af_uplink_0++;
      }
@@ -157,29 +151,20 @@ void IdealSimulator::log_rates() {
 }
 void IdealSimulator::add_next_flow_to_active_flows() {
   std::cout << "add next flow to active flows " << next_flow << "\n";
-  if (curr_time != next_start) {
+  if (engine->get_time() != next_start) {
     std::cerr << "curr_time not up to date, add next at "
 	      << next_start << "\n";
     exit(1);
   }
 
-  flow_start[next_flow] = next_start;
-  flow_bytes[next_flow] = next_num_bytes;
-  active_flow_paths[next_flow] = next_path;
-  active_flow_bytes[next_flow] = next_num_bytes;
-  active_flow_weights[next_flow] = 1;
-  if (next_num_bytes < min_bytes_for_priority_) {
-    active_flow_weights.at(next_flow) = priority_weight_;
-  }
-
-  // calculate rates since new flow was added
-  wf->do_waterfilling(active_flow_paths, active_flow_weights, rates);
+  engine->add_flow(next_flow, next_path, next_num_bytes, flow_weight(next_num_bytes));
 
+  // calculate rates since new flow was added and
   // reset finish times since rates for flows 
   // have changed (and new flow's added)
-  get_new_finish_times();
+  engine->update_rates();
 
-  if (next_finish < 0) {
+  if (engine->get_next_finish() < 0) {
     std::cerr << "added flow " << next_flow
 	      << " and got new rates but didn't get next_finish.\n";
     exit(1);
@@ -189,127 +174,39 @@ void IdealSimulator::add_next_flow_to_active_flows() {
   get_next_flow();
 }
 
-void IdealSimulator::get_new_finish_times() {
-  // reset old finish times
-  next_finish = -1;
-  next_flow_to_finish = -1;
-
-  // and get new finish times
-  std::map<int, double> finish_times;
-  double min_finish_dur = -1;
-  double min_finish_flow = -1;
-  for (auto f: active_flow_bytes) {
-    if (rates.count(f.first) == 0 ||
-	rates.at(f.first) <= 0) {
-      std::cerr << "invalid rate for flow " << f.first << std::endl;
-    }
-    if (f.second < -1e-6) {
-      std::cerr << "flow " << f.first << " has invalid bytes " 
-		<< f.second << std::endl;
-    }
-    // rate is in gb/s, size is in bytes
-    double rate = rates.at(f.first);
-    double dur = (f.second * 8) / (rate * 1e9);
-    //std::cout << "flow " << f.first << " would finish in "
-    //	      << dur << "\n";
-    if (min_finish_dur == -1 or dur < min_finish_dur) {
-      min_finish_dur = dur;
-      min_finish_flow = f.first;
-    }
-  }
 
-  if (min_finish_dur > 0) {
-    next_finish = curr_time + min_finish_dur;
-    next_flow_to_finish = min_finish_flow;
-  }
-  return;
-}
 
-void IdealSimulator::drain_active_flows(double dur) {
-  if (dur <= 0) {
-    std::cerr << "possibly invalid dur " << dur 
-	      << " at curr_time " << curr_time
-	      << " exit if < -1us"
-	      << std::endl;
-    if (dur < -1e-6) exit(1);
-    return;
-  }
-
-  std::vector<double> new_bytes_values;
-  std::vector<int> new_bytes_flows;
-
-  for (auto f: active_flow_bytes) {
-    if (rates.count(f.first) == 0 ||
-	rates.at(f.first) <= 0) {
-      std::cerr << "invalid rate for flow " << f.first << std::endl;
-    }
-    if (f.second <= 0) {
-      std::cerr << "flow " << f.first << " has invalid bytes " 
-		<< f.second << std::endl;
-    }
-    // rate is in gb/s, size is in bytes
-    double rate = rates.at(f.first);
-    // double dur = (f.second * 8) / (rate * 1e9);
-    double bytes_drained = (rate * 1e9 * dur)/8;
-    double new_bytes = f.second - bytes_drained;
-    if (new_bytes <= 0) {
-      std::cerr << "flow " << f.first << " has negative bytes after drain " 
-		<< new_bytes << std::endl;
-      if (new_bytes < -1) {
-	exit(1);
-      }
-    }
-    new_bytes_values.push_back(new_bytes);
-    new_bytes_flows.push_back(f.first);
-  }
+void IdealSimulator::flow_finished(const FinishedFlow& flow, double fldur) {
+  last_wait = 0;
+  if (quantum <= 0) return;
+  // how late the flow started, its fct is at most that much over
+  // flows from a checkpoint taken without --quantum didn't wait
+  // the flow still has its slot while it's reported
+  int slot = engine->get_flows().find(flow.flow_id);
+  if (slot >= 0 and slot < (int) arrival_wait.size()) last_wait = arrival_wait[slot];
+  double lag = flow.released - flow.end;
+  num_quantum_flows++;
+  sum_wait += last_wait;
+  max_wait = std::max(max_wait, last_wait);
+  sum_lag += lag;
+  max_lag = std::max(max_lag, lag);
+  double share = fldur > 0 ? last_wait / fldur : 0;
+  sum_wait_share += share;
+  max_wait_share = std::max(max_wait_share, share);
+}
 
-  int n = new_bytes_values.size();
-  for (int i = 0; i < n; i++) {
-    double bytes = new_bytes_values.at(i);
-    int flow = new_bytes_flows.at(i);
-    active_flow_bytes.at(flow) = bytes;
-  }
-  return;
+void IdealSimulator::write_fct_fields(const FinishedFlow&) {
+  if (quantum > 0) out_file << " wait " << last_wait;
 }
 
 // curr_time must be up to date
 void IdealSimulator::remove_flows_that_have_finished()
 {
-  std::vector<int> flows_to_remove;
-  for (auto f : active_flow_bytes) {
-    if (f.second < 1e-3) {
-      flows_to_remove.push_back(f.first);
-    }
-  }
-  
-  int num_flows_removed = 0;
-  for (auto f : flows_to_remove) {
-    double fldur = curr_time - flow_start.at(f) ;
-    int src = active_flow_paths.at(f).front().first;
-    int dst = active_flow_paths.at(f).back().second;
-    // input file has bytes on the wire
-    double payload_bytes = (flow_bytes.at(f)/1500.0)*1460.0;
-    out_file << "fid " << f 
-		<< std::setprecision(12)
-		<< " end_time " << curr_time
-		<< " start_time " << flow_start.at(f) 
-		<< " fldur " << fldur
-		<< std::setprecision(5)
-	     << " num_bytes " << flow_bytes.at(f)
-		<< " tmp_pkts " 
-		<< std::round(flow_bytes.at(f)/1460.0) 
-		<< " gid "
-		<< src << "-" << dst
-		<< "\n";
-    num_flows_removed++;
-    active_flow_bytes.erase(f);
-    active_flow_paths.erase(f);
-    active_flow_weights.erase(f);
-    flow_end[f] = curr_time;
-  }
+  // writes their fcts in flow id order
+  int num_flows_removed = engine->retire_finished();
 
   std::cout << num_flows_removed 
-	    << " flows were removed at " << curr_time << std::endl;
+	    << " flows were removed at " << engine->get_time() << std::endl;
 
   // calculate rates since we removed some flows
   if (!num_flows_removed) {
@@ -317,59 +214,64 @@ void IdealSimulator::remove_flows_that_have_finished()
     exit(1);
   }
 
-  rates.clear();
-  if (active_flow_paths.size() > 0) {
-    wf->do_waterfilling(active_flow_paths, active_flow_weights, rates);
-  }
-  // reset finish times since we removed some flows
-  get_new_finish_times();
+  // and reset finish times since we removed some flows
+  engine->update_rates();
 
   return;
 }
 
 void IdealSimulator::run() {
+  if (quantum > 0) {
+    report(run_quantized());
+    return;
+  }
+  if (not restored) {
   std::cout << "get next flow first time\n";
  get_next_flow();
+ }
 
  // we move curr_time ahead each time we drain flows ..
- if (!active_flow_paths.size()) {
+ if (not restored and !engine->get_flows().num_active()) {
    if (next_flow > 0) {
      std::cout << "add next flow to active flows first time\n";
      // will reset next finish and next start
-     curr_time = next_start;
+     drain_until(next_start);
      add_next_flow_to_active_flows();
      log_rates();
      std::cout << "next start " << next_flow << " at "
 	       << std::setprecision(12)
 	       << next_start << "\n";
-     std::cout << "next finish " << next_flow_to_finish << " at " 
+     std::cout << "next finish " << engine->get_next_flow_to_finish() << " at " 
 	       << std::setprecision(12)
-	       << next_finish << "\n";
+	       << engine->get_next_finish() << "\n";
    }
  } 
 
  bool next_event_is_a_start = true;
  double next_event_time = next_start;
 
- int num_events = 0;
- while ((next_start > 0 or next_finish > 0) and next_event_time < max_sim_time_) {
+#ifdef WF_COUNT_ALLOCS
+ start_event_allocations();
+#endif
+ int num_events = restored_events;
+ while ((next_start > 0 or engine->get_next_finish() > 0) and next_event_time < max_sim_time_) {
    num_events++;
    // see which event to simulate first
    // adding new flow or removing an old flow
    // in either case drain flows until event time first
-   if (next_start > 0 and next_finish > 0) {
-     if (next_start < next_finish) {
+   if (next_start > 0 and engine->get_next_finish() > 0) {
+     if (next_start < engine->get_next_finish()) {
        next_event_is_a_start = true;
        next_event_time = next_start;
        std::cout << "next event start " 
 		 << next_flow << " " << next_start << "\n";
      } else {
        next_event_is_a_start = false;
-       next_event_time = next_finish;
+       next_event_time = engine->get_next_finish();
 
        std::cout << "next event finish " 
-		 << next_flow_to_finish << " "
-		 << next_flow_to_finish << "\n";
+		 << engine->get_next_flow_to_finish() << " "
+		 << engine->get_next_flow_to_finish() << "\n";
 
      }
    } else if (next_start > 0) {
@@ -380,11 +282,11 @@ void IdealSimulator::run() {
      next_event_time = next_start;
    } else {
      next_event_is_a_start = false;
-     next_event_time = next_finish;
+     next_event_time = engine->get_next_finish();
 
      std::cout << "next event finish " 
-	       << next_flow_to_finish << " "
-	       << next_flow_to_finish << "\n";
+	       << engine->get_next_flow_to_finish() << " "
+	       << engine->get_next_flow_to_finish() << "\n";
    }
 
    
@@ -397,9 +299,7 @@ void IdealSimulator::run() {
    std::cout << "drain_active_flows_until " 
 	     << next_event_time  << std::endl;
 
-   double dur = next_event_time - curr_time;
-   drain_active_flows(dur);
-   curr_time = next_event_time;
+   drain_until(next_event_time);
    if (next_event_is_a_start) {
      // will reset next start and next finish
      add_next_flow_to_active_flows();
@@ -409,9 +309,9 @@ void IdealSimulator::run() {
      std::cout << "next start " << next_flow << " at "
 	       << std::setprecision(12)
 	       << next_start << "\n";
-     std::cout << "next finish " << next_flow_to_finish << " at " 
+     std::cout << "next finish " << engine->get_next_flow_to_finish() << " at " 
 	       << std::setprecision(12)
-	       << next_finish << "\n";
+	       << engine->get_next_finish() << "\n";
 
    } else {
      // will reset next finish
@@ -422,22 +322,140 @@ void IdealSimulator::run() {
      std::cout << "next start " << next_flow << " at "
 	       << std::setprecision(12)
 	       << next_start << "\n";
-     std::cout << "next finish " << next_flow_to_finish << " at " 
+     std::cout << "next finish " << engine->get_next_flow_to_finish() << " at " 
 	       << std::setprecision(12)
-	       << next_finish << "\n";
+	       << engine->get_next_finish() << "\n";
 
    }
+#ifdef WF_COUNT_ALLOCS
+   check_event_allocations();
+#endif
    if (next_event_time >= max_sim_time_) {
      std::cout << "next_event_time " << next_event_time 
 	       << " exceeds max_sim_time_ " << max_sim_time_
 	       << std::endl;
+     // a longer run, or variants of this one, can pick up from here
+     if (not checkpoint_file.empty()) save(checkpoint_file, num_events);
      break;
 
    }
+   maybe_checkpoint(num_events);
  }
+ report(num_events);
+}
 
+// events in (boundary - quantum, boundary] all happen at boundary:
+// flows that finished in there are reported with their own end but keep
+// their bandwidth until it, flows that arrived are added at it, then one
+// solve. quanta with nothing in them are skipped, so there are at most
+// as many solves as events, and no more than simulated time / quantum
+int IdealSimulator::run_quantized() {
+ if (not restored) get_next_flow();
+#ifdef WF_COUNT_ALLOCS
+ start_event_allocations();
+#endif
+ int num_quanta = restored_events;
+ while (next_start > 0 or engine->get_next_finish() > 0) {
+   double next_event_time = next_start;
+   if (engine->get_next_finish() > 0
+       and (next_event_time < 0 or engine->get_next_finish() < next_event_time)) {
+     next_event_time = engine->get_next_finish();
+   }
+   if (next_event_time >= max_sim_time_) {
+     std::cout << "next_event_time " << next_event_time
+	       << " exceeds max_sim_time_ " << max_sim_time_
+	       << std::endl;
+     if (not checkpoint_file.empty()) save(checkpoint_file, num_quanta);
+     break;
+   }
+   num_quanta++;
+   // in whole quanta, but index * quantum can round to just under the
+   // event, which would then never happen
+   long index = (long) std::ceil(next_event_time / quantum);
+   double boundary = std::max(index * quantum, next_event_time);
+   if (boundary > engine->get_time()) drain_until(boundary);
+   int num_flows_removed = engine->retire_finished();
+   int num_flows_added = 0;
+   while (next_start > 0 and next_start <= boundary) {
+     int slot = engine->add_flow(next_flow, next_path, next_num_bytes,
+				 flow_weight(next_num_bytes), next_start);
+     if (slot >= (int) arrival_wait.size()) arrival_wait.resize(engine->get_flows().num_slots());
+     arrival_wait[slot] = boundary - next_start;
+     num_flows_added++;
+     get_next_flow();
+   }
+   engine->update_rates();
+   std::cout << "quantum at " << std::setprecision(12) << boundary
+	     << " removed " << num_flows_removed
+	     << " added " << num_flows_added << "\n";
+#ifdef WF_COUNT_ALLOCS
+   check_event_allocations();
+#endif
+   maybe_checkpoint(num_quanta);
+ }
+ return num_quanta;
+}
+
+void IdealSimulator::save_state(std::ostream& out) {
+  checkpoint_put(out, next_start);
+  checkpoint_put(out, next_flow);
+  checkpoint_put(out, next_path);
+  checkpoint_put(out, next_num_bytes);
+  checkpoint_put(out, quantum);
+  checkpoint_put(out, num_quantum_flows);
+  checkpoint_put(out, sum_wait);
+  checkpoint_put(out, max_wait);
+  checkpoint_put(out, sum_lag);
+  checkpoint_put(out, max_lag);
+  checkpoint_put(out, sum_wait_share);
+  checkpoint_put(out, max_wait_share);
+  // slots come back the same with the flow table
+  checkpoint_put(out, arrival_wait);
+}
+
+void IdealSimulator::restore_state(std::istream& in) {
+  checkpoint_get(in, next_start);
+  checkpoint_get(in, next_flow);
+  checkpoint_get(in, next_path);
+  checkpoint_get(in, next_num_bytes);
+  // not set_quantum(), the engine came back coalescing or not already
+  checkpoint_get(in, quantum);
+  checkpoint_get(in, num_quantum_flows);
+  checkpoint_get(in, sum_wait);
+  checkpoint_get(in, max_wait);
+  checkpoint_get(in, sum_lag);
+  checkpoint_get(in, max_lag);
+  checkpoint_get(in, sum_wait_share);
+  checkpoint_get(in, max_wait_share);
+  checkpoint_get(in, arrival_wait);
 }
 
+void IdealSimulator::simulator_report(int num_events) {
+ if (quantum > 0) {
+   long n = std::max(num_quantum_flows, 1L);
+   std::cout << num_events << " quanta of " << quantum << " s, "
+	     << num_quantum_flows << " flows waited " << sum_wait / n
+	     << " s on average to start (max " << max_wait
+	     << "), held their bandwidth " << sum_lag / n
+	     << " s past their end (max " << max_lag
+	     << "), the wait is " << 100 * sum_wait_share / n
+	     << "% of fct on average (max " << 100 * max_wait_share << "%)\n";
+ }
+}
+
+void IdealSimulator::apply_options(const Options& options) {
+  TraceSimulator::apply_options(options);
+  // a restored run goes on with the checkpoint's quantum, the flag can
+  // only repeat it
+  if (not restored) {
+    set_quantum(options.has("quantum") ? options.get_double("quantum", 1e-5) : 0);
+  } else if (options.has("quantum") and options.get_double("quantum", 1e-5) != quantum) {
+    std::cerr << "--quantum=" << options.get_double("quantum", 1e-5)
+	      << " given but the checkpoint was saved with a quantum of "
+	      << quantum << " s\n";
+    exit(1);
+  }
+}
 
 
 
@@ -497,15 +515,9 @@ void IdealSimulator::run() {
 
 
 int main(int argc, char** argv) {
-  if (argc != 7) {
-    std::cerr << "Expected 6 arguments to binary- flow, out and link file, min bytes for priority, priority weight, max_sim_time\n";
-    exit(1);
-  }
-  std::cout << "Got " << argv[1] << ", " << argv[2] << ", " << argv[3]
-	    << atof(argv[4]) << ", " << atof(argv[5]) << ", " << atof(argv[6])
-	    << std::endl;
   //IdealSimulator sim("flow_file.txt","out_file.txt","link_file.txt");
   //IdealSimulator sim("all-topo0-80pc.txt","fcts-96-topo0-80pc.txt","l1-96.txt");
-  IdealSimulator sim(argv[1], argv[2], argv[3], atof(argv[4]), atof(argv[5]), atof(argv[6]));
-  sim.run();
+  // the shared flags (trace_simulator.h), and --quantum=seconds applies
+  // the events in each quantum together
+  return simulator_main<IdealSimulator>(argc, argv, {"quantum"});
 }
@@ -1,63 +1,61 @@
-#include "weighted_waterfilling.h"
-#include <memory>
+#include "trace_simulator.h"
 #include <string>
-#include <sstream>
-#include <fstream>
+#include <vector>
 
-class IdealSimulator {
+class IdealSimulator : public TraceSimulator {
  protected:
-  std::string flow_filename;
-  std::string out_filename;
-  std::string link_filename;
-
-  double min_bytes_for_priority_;
-  double priority_weight_;
-  double max_sim_time_;
-
-  //std::map<int, double> flow_arrivals;
-  //std::map<int, std::vector< link_t > > flow_paths;
-
-  std::map<int, std::vector< link_t > > active_flow_paths;
-  std::map<int, double > active_flow_bytes;
-  std::map<int, double > active_flow_weights;
-
-  std::map<int, double> flow_start;
-  std::map<int, double> flow_end;
-  std::map<int, double> flow_bytes;
-
-  std::unique_ptr<WeightedWaterfilling> wf;
-
-  std::ifstream flow_file;
-  std::ofstream out_file;
-  double curr_time = -1;
-
-  std::map<int, double> rates;
-
-  double next_finish = -1;
-  double next_flow_to_finish = -1;
-
   double next_start = -1;
   int next_flow = -1;
-  std::vector< link_t > next_path;
+  int next_path = -1;
   double next_num_bytes = -1;
   // read flow_file and populate next_start, next_flow, .. 
   // with details of next flow to start
   bool get_next_flow(); 
-  bool parse_line(const std::string line);
+  bool parse_line(const std::string& line);
 
   void add_next_flow_to_active_flows();
-  void drain_active_flows(double dur);
   void remove_flows_that_have_finished();
-  void get_new_finish_times();
+  void flow_finished(const FinishedFlow& flow, double fldur) override;
+  void write_fct_fields(const FinishedFlow& flow) override;
   void log_rates();
+  void simulator_report(int num_events) override;
+
+  // --quantum: arrivals and finishes are applied together at the next
+  // multiple of quantum, one solve per quantum (see run_quantized())
+  double quantum = 0;
+  std::vector< double > arrival_wait; // by flow table slot, how late it was added
+  double last_wait = 0; // of the flow whose fct is being written
+  // what that cost, over finished flows
+  long num_quantum_flows = 0;
+  double sum_wait = 0, max_wait = 0;
+  double sum_lag = 0, max_lag = 0; // bandwidth held past the flow's end
+  double sum_wait_share = 0, max_wait_share = 0; // wait / fct
+  int run_quantized();
+
+  // the flow read ahead, the quantum and its stats
+  const char* checkpoint_kind() const override { return "wsim"; }
+  void save_state(std::ostream& out) override;
+  void restore_state(std::istream& in) override;
+#ifdef WF_COUNT_ALLOCS
+  size_t scratch_high_water() override;
+  void rewind_trace() override;
+#endif
  public:
   IdealSimulator(const std::string& flow_filename, 
 		 const std::string& out_filename,
 		 const std::string& link_filename,
 		 double min_bytes_for_priority,
 		 double priority_weight,
-		 double max_sim_time);
-
-  ~IdealSimulator();
-  void run();
+		 double max_sim_time,
+		 const std::string& restore_from = "");
+
+  void run() override;
+  // --quantum on top of the shared flags
+  void apply_options(const Options& options) override;
+  double get_quantum() const { return quantum; }
+  // seconds, 0 simulates every event on its own
+  void set_quantum(double q) {
+    quantum = q;
+    engine->set_coalescing(q > 0);
+  }
 };
@@ -0,0 +1,87 @@
+#include "kll_sketch.h"
+#include <algorithm>
+#include <cmath>
+
+KllSketch::KllSketch(int k) : k(std::max(k, 8)) {
+  grow();
+}
+
+int KllSketch::capacity(int level) const {
+  // the top level holds k, each one below 2/3 of the one above
+  int depth = compactors.size() - level - 1;
+  return (int) std::ceil(std::pow(2.0 / 3.0, depth) * k) + 1;
+}
+
+void KllSketch::grow() {
+  compactors.emplace_back();
+  max_held = 0;
+  for (int level = 0; level < (int) compactors.size(); level++) max_held += capacity(level);
+}
+
+bool KllSketch::flip_coin() {
+  // xorshift64
+  coin_state ^= coin_state << 13;
+  coin_state ^= coin_state >> 7;
+  coin_state ^= coin_state << 17;
+  return coin_state & 1;
+}
+
+void KllSketch::compress() {
+  for (int level = 0; level < (int) compactors.size(); level++) {
+    if ((int) compactors[level].size() < capacity(level)) continue;
+    if (level + 1 == (int) compactors.size()) grow();
+    std::vector< double >& items = compactors[level];
+    std::vector< double >& up = compactors[level + 1];
+    // an odd one out stays behind
+    double left_over = 0;
+    bool odd = items.size() % 2 == 1;
+    if (odd) {
+      left_over = items.back();
+      items.pop_back();
+    }
+    std::sort(items.begin(), items.end());
+    for (size_t i = flip_coin() ? 1 : 0; i < items.size(); i += 2) up.push_back(items[i]);
+    num_held -= items.size() / 2;
+    items.clear();
+    if (odd) items.push_back(left_over);
+    if (num_held < max_held) break;
+  }
+}
+
+void KllSketch::add(double value) {
+  if (n == 0 or value < min_value) min_value = value;
+  if (n == 0 or value > max_value) max_value = value;
+  n++;
+  compactors[0].push_back(value);
+  num_held++;
+  if (num_held >= max_held) compress();
+}
+
+double KllSketch::quantile(double q) const {
+  if (n == 0) return 0;
+  if (q <= 0) return min_value;
+  if (q >= 1) return max_value;
+  weighted.clear();
+  double total = 0;
+  for (int level = 0; level < (int) compactors.size(); level++) {
+    double weight = std::ldexp(1.0, level);
+    for (double value : compactors[level]) {
+      weighted.push_back(std::make_pair(value, weight));
+      total += weight;
+    }
+  }
+  std::sort(weighted.begin(), weighted.end());
+  double rank = q * total;
+  double below = 0;
+  for (auto& vw : weighted) {
+    below += vw.second;
+    if (below >= rank) return vw.first;
+  }
+  return max_value;
+}
+
+size_t KllSketch::capacity_held() const {
+  size_t held = compactors.capacity() + weighted.capacity();
+  for (auto& c : compactors) held += c.capacity();
+  return held;
+}
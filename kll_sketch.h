@@ -0,0 +1,49 @@
+#ifndef KLL_SKETCH_H
+#define KLL_SKETCH_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// Quantiles of a stream of values in bounded memory (Karnin, Lang and
+// Liberty's KLL sketch). Values go into a stack of compactors, level h
+// holding items that each stand for 2^h values; a full level is sorted
+// and every other item (from a coin flipped offset) moves up a level.
+// Lower levels get geometrically smaller capacities, so the sketch holds
+// O(k log(n / k)) values and a quantile's rank is off by about 1.7 / k
+// of n. The coin comes from a fixed seed, a run's sketches are the same
+// every time. Min and max are kept exactly.
+class KllSketch {
+ protected:
+  int k;
+  std::vector< std::vector< double > > compactors; // by level
+  size_t num_held = 0; // items in all compactors
+  size_t max_held = 0; // sum of the level capacities
+  long n = 0;
+  double min_value = 0;
+  double max_value = 0;
+  uint64_t coin_state = 0x9e3779b97f4a7c15ull;
+
+  int capacity(int level) const;
+  void grow();
+  void compress();
+  bool flip_coin();
+
+  // scratch for quantile()
+  mutable std::vector< std::pair< double, double > > weighted;
+
+ public:
+  explicit KllSketch(int k = 200);
+
+  void add(double value);
+  // the value at rank q * n, q in [0, 1]. 0 if nothing was added
+  double quantile(double q) const;
+  long count() const { return n; }
+  double min() const { return min_value; }
+  double max() const { return max_value; }
+  size_t num_items() const { return num_held; }
+  // sums the compactors' sizes, only goes up (see alloc_count.h)
+  size_t capacity_held() const;
+};
+
+#endif
@@ -0,0 +1,131 @@
+#include "link_stats.h"
+#include <iostream>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+
+LinkStats::LinkStats(const Topology& topology, const PathTable& paths,
+		     const std::string& filename, double interval)
+  : topology(topology), paths(paths), out(filename), interval(interval) {
+  if (not out.is_open()) {
+    std::cerr << "Unable to open file " << filename << std::endl;
+    exit(1);
+  }
+  int num_links = topology.num_links();
+  load.assign(num_links, 0);
+  num_flows.assign(num_links, 0);
+  integrated_to.assign(num_links, 0);
+  load_integral.assign(num_links, 0);
+  flow_integral.assign(num_links, 0);
+  total_load_integral.assign(num_links, 0);
+  total_flow_integral.assign(num_links, 0);
+  is_used.assign(num_links, false);
+  out << "kind,from,to,link,src,dst,capacity,mean_load,utilization,mean_flows\n";
+  out.precision(9);
+}
+
+void LinkStats::integrate(int link, double time) {
+  double dt = time - integrated_to[link];
+  if (dt > 0) {
+    load_integral[link] += load[link] * dt;
+    flow_integral[link] += num_flows[link] * dt;
+  }
+  integrated_to[link] = time;
+}
+
+void LinkStats::use(int link) {
+  if (is_used[link]) return;
+  is_used[link] = true;
+  used.push_back(link);
+}
+
+void LinkStats::add_flow(int path, double time) {
+  if (start < 0) {
+    start = time;
+    interval_start = time;
+    if (interval > 0) interval_index = (long) std::floor(time / interval);
+  }
+  path_links.update(paths, topology);
+  for (const int* l = path_links.begin(path); l != path_links.end(path); l++) {
+    integrate(*l, time);
+    use(*l);
+    num_flows[*l]++;
+  }
+}
+
+void LinkStats::remove_flow(int path, double rate, double time) {
+  for (const int* l = path_links.begin(path); l != path_links.end(path); l++) {
+    integrate(*l, time);
+    // an empty link carries nothing, whatever rounding left in the sum
+    if (--num_flows[*l] == 0) load[*l] = 0;
+    else load[*l] -= rate;
+  }
+}
+
+void LinkStats::change_rate(int path, double delta, double time) {
+  for (const int* l = path_links.begin(path); l != path_links.end(path); l++) {
+    integrate(*l, time);
+    load[*l] += delta;
+  }
+}
+
+void LinkStats::write_row(const char* kind, double from, double to, int link,
+			  double load_integral, double flow_integral) {
+  double length = to - from;
+  if (length <= 0) return;
+  double mean_load = load_integral / length;
+  link_t ends = topology.get_link(link);
+  out << kind << "," << from << "," << to << "," << link << ","
+      << ends.first << "," << ends.second << "," << topology.capacity(link) << ","
+      << mean_load << "," << mean_load / topology.capacity(link) << ","
+      << flow_integral / length << "\n";
+}
+
+void LinkStats::end_interval(double time) {
+  int num_used = used.size();
+  for (int i = 0; i < num_used; i++) {
+    int link = used[i];
+    integrate(link, time);
+    if (interval > 0 and flow_integral[link] > 0) {
+      write_row("interval", interval_start, time, link, load_integral[link], flow_integral[link]);
+    }
+    total_load_integral[link] += load_integral[link];
+    total_flow_integral[link] += flow_integral[link];
+    load_integral[link] = 0;
+    flow_integral[link] = 0;
+  }
+  // links that still have flows are used in the next interval too
+  int kept = 0;
+  for (int i = 0; i < num_used; i++) {
+    int link = used[i];
+    if (num_flows[link] > 0) used[kept++] = link;
+    else is_used[link] = false;
+  }
+  used.resize(kept);
+  interval_start = time;
+}
+
+void LinkStats::advance(double time) {
+  if (interval <= 0 or start < 0) return;
+  while ((interval_index + 1) * interval <= time) {
+    interval_index++;
+    end_interval(interval_index * interval);
+    if (used.empty()) {
+      // nothing running, skip to the interval time is in
+      interval_index = std::max(interval_index, (long) std::floor(time / interval));
+      interval_start = interval_index * interval;
+    }
+  }
+}
+
+void LinkStats::write_report(double time) {
+  if (start < 0) return;
+  advance(time);
+  end_interval(time);
+  for (int link = 0; link < topology.num_links(); link++) {
+    if (total_flow_integral[link] > 0) {
+      write_row("total", start, time, link, total_load_integral[link], total_flow_integral[link]);
+    }
+  }
+  out.flush();
+}
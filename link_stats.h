@@ -0,0 +1,65 @@
+#ifndef LINK_STATS_H
+#define LINK_STATS_H
+
+#include "waterfilling_solver.h"
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Time-weighted load and active flow count of every link, integrated as
+// the simulation runs instead of rebuilt from RATE_CHANGE lines after
+// it. Loads and counts are kept per link and only the links on a flow
+// that comes, goes or changes rate are integrated up to the current time
+// (rates are constant between solves, so the integrals are exact).
+// Every interval seconds the links used in it get a CSV row, and
+// write_report() adds one row per link over the whole run:
+//
+//   kind,from,to,link,src,dst,capacity,mean_load,utilization,mean_flows
+//
+// kind is "interval" or "total", loads in Gb/s like the rates.
+class LinkStats {
+ protected:
+  const Topology& topology;
+  const PathTable& paths;
+  PathLinkIds path_links;
+  std::ofstream out;
+  double interval;
+  double start = -1; // time of the first flow
+  double interval_start = -1;
+  long interval_index = 0; // interval_start is in [i, i+1) * interval
+
+  // by topology link
+  std::vector< double > load; // Gb/s
+  std::vector< int > num_flows;
+  std::vector< double > integrated_to; // time load and num_flows hold from
+  std::vector< double > load_integral; // this interval, Gb/s * s
+  std::vector< double > flow_integral; // flows * s
+  std::vector< double > total_load_integral;
+  std::vector< double > total_flow_integral;
+  // links with flows or an integral this interval
+  std::vector< int > used;
+  std::vector< bool > is_used;
+
+  void integrate(int link, double time);
+  void use(int link);
+  void write_row(const char* kind, double from, double to, int link,
+		 double load_integral, double flow_integral);
+  void end_interval(double time);
+
+ public:
+  // interval 0 writes only the final report
+  LinkStats(const Topology& topology, const PathTable& paths,
+	    const std::string& filename, double interval);
+
+  // at time, a flow on path with rate (Gb/s) joins, leaves or has its
+  // rate change by delta
+  void add_flow(int path, double time);
+  void remove_flow(int path, double rate, double time);
+  void change_rate(int path, double delta, double time);
+  // writes the intervals that end by time, call before time moves on
+  void advance(double time);
+  // the last interval and one total row per link used, through time
+  void write_report(double time);
+};
+
+#endif
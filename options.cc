@@ -0,0 +1,41 @@
+#include "options.h"
+#include <iostream>
+#include <algorithm>
+#include <cstdlib>
+
+Options::Options(int argc, char** argv, int first, const std::vector< std::string >& known) {
+  for (int i = first; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg.compare(0, 2, "--") != 0) {
+      std::cerr << "expected an option (--name or --name=value), got " << arg << "\n";
+      exit(1);
+    }
+    size_t eq = arg.find('=');
+    std::string name = arg.substr(2, eq == std::string::npos ? std::string::npos : eq - 2);
+    if (std::find(known.begin(), known.end(), name) == known.end()) {
+      std::cerr << "unknown option --" << name << ", known ones are";
+      for (const auto& k : known) std::cerr << " --" << k;
+      std::cerr << "\n";
+      exit(1);
+    }
+    values[name] = eq == std::string::npos ? "" : arg.substr(eq + 1);
+  }
+}
+
+std::string Options::get(const std::string& name, const std::string& def) const {
+  auto it = values.find(name);
+  if (it == values.end() or it->second.empty()) return def;
+  return it->second;
+}
+
+double Options::get_double(const std::string& name, double def) const {
+  std::string value = get(name);
+  if (value.empty()) return def;
+  char* end;
+  double d = strtod(value.c_str(), &end);
+  if (*end != '\0') {
+    std::cerr << "--" << name << " expects a number, got " << value << "\n";
+    exit(1);
+  }
+  return d;
+}
@@ -0,0 +1,22 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+// optional "--name" or "--name=value" flags after a binary's positional
+// arguments, a flag that isn't one of the known names is an error
+class Options {
+ protected:
+  std::map< std::string, std::string > values;
+ public:
+  // parses argv[first] .. argv[argc-1], exits on anything unknown
+  Options(int argc, char** argv, int first, const std::vector< std::string >& known);
+  bool has(const std::string& name) const { return values.count(name) > 0; }
+  // the flag's value, def if it wasn't given (or given without a value)
+  std::string get(const std::string& name, const std::string& def = "") const;
+  double get_double(const std::string& name, double def) const;
+};
+
+#endif
@@ -0,0 +1,64 @@
+#include "path_table.h"
+#include "checkpoint.h"
+#include <algorithm>
+#include <iostream>
+#include <cstdlib>
+
+size_t PathTable::PathHash::operator()(int path) const {
+  size_t h = 14695981039346656037ULL;
+  for (const link_t* l = table->begin(path); l != table->end(path); l++) {
+    h = (h ^ (size_t) l->first) * 1099511628211ULL;
+    h = (h ^ (size_t) l->second) * 1099511628211ULL;
+  }
+  return h;
+}
+
+bool PathTable::PathEqual::operator()(int a, int b) const {
+  return table->size(a) == table->size(b)
+    and std::equal(table->begin(a), table->end(a), table->begin(b));
+}
+
+PathTable::PathTable()
+  : offsets(1, 0), index(64, PathHash{this}, PathEqual{this}) {}
+
+PathTable& PathTable::global() {
+  static PathTable table;
+  return table;
+}
+
+int PathTable::intern(const link_t* first, const link_t* last) {
+  // append the path as a candidate id, keep it only if it's new
+  int candidate = num_paths();
+  links.insert(links.end(), first, last);
+  offsets.push_back(links.size());
+  auto it = index.find(candidate);
+  if (it != index.end()) {
+    links.resize(offsets[candidate]);
+    offsets.pop_back();
+    return *it;
+  }
+  index.insert(candidate);
+  return candidate;
+}
+
+void PathTable::save(std::ostream& out) const {
+  checkpoint_put(out, links);
+  checkpoint_put(out, offsets);
+}
+
+void PathTable::restore(std::istream& in) {
+  std::vector< link_t > saved_links;
+  std::vector< int > saved_offsets;
+  checkpoint_get(in, saved_links);
+  checkpoint_get(in, saved_offsets);
+  if (not in.good()) return; // the caller finds out
+  for (size_t p = 0; p + 1 < saved_offsets.size(); p++) {
+    const link_t* first = saved_links.data() + saved_offsets[p];
+    const link_t* last = saved_links.data() + saved_offsets[p + 1];
+    if (intern(first, last) != (int) p) {
+      std::cerr << "restored path " << p << " doesn't get its old id,"
+		<< " paths were interned before the restore\n";
+      exit(1);
+    }
+  }
+}
@@ -0,0 +1,61 @@
+#ifndef PATH_TABLE_H
+#define PATH_TABLE_H
+
+#include <vector>
+#include <unordered_set>
+#include <cstddef>
+#include <iosfwd>
+#include <utility> // std::pair
+typedef std::pair<int, int> link_t;
+
+// Interns link sequences so every distinct path is stored once and flows
+// only carry a small path id. All paths live back to back in one vector,
+// path p is links[offsets[p]] .. links[offsets[p+1]-1]. Ids are never
+// reused, the table only grows with the number of distinct paths (which
+// is bounded by the topology, not by the trace).
+class PathTable {
+ protected:
+  std::vector< link_t > links;
+  std::vector< int > offsets;
+
+  // hash and compare path ids by their links in this table
+  struct PathHash {
+    const PathTable* table;
+    size_t operator()(int path) const;
+  };
+  struct PathEqual {
+    const PathTable* table;
+    bool operator()(int a, int b) const;
+  };
+  std::unordered_set< int, PathHash, PathEqual > index;
+
+ public:
+  PathTable();
+  // table shared by the trace reader, simulator and solver
+  static PathTable& global();
+
+  // id of the path, adding it if we haven't seen it before,
+  // [first, last) must not point into this table
+  int intern(const link_t* first, const link_t* last);
+  int intern(const std::vector< link_t >& path) {
+    return intern(path.data(), path.data() + path.size());
+  }
+
+  const link_t* begin(int path) const { return links.data() + offsets[path]; }
+  const link_t* end(int path) const { return links.data() + offsets[path + 1]; }
+  int size(int path) const { return offsets[path + 1] - offsets[path]; }
+  const link_t& front(int path) const { return links[offsets[path]]; }
+  const link_t& back(int path) const { return links[offsets[path + 1] - 1]; }
+  int num_paths() const { return offsets.size() - 1; }
+  // entries reserved for links and offsets, grows when they reallocate
+  size_t storage_capacity() const { return links.capacity() + offsets.capacity(); }
+  // all paths in id order (checkpoint.h). restore() interns them into
+  // an empty table so they get the same ids
+  void save(std::ostream& out) const;
+  void restore(std::istream& in);
+  std::vector< link_t > get_path(int path) const {
+    return std::vector< link_t >(begin(path), end(path));
+  }
+};
+
+#endif
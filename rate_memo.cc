@@ -0,0 +1,93 @@
+#include "rate_memo.h"
+#include <cstring>
+#include <algorithm>
+
+// splitmix64's finalizer, spreads every input bit over the output
+static uint64_t mix(uint64_t x) {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ull;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebull;
+  x ^= x >> 31;
+  return x;
+}
+
+uint64_t RateMemo::signature(const int* paths, const double* weights,
+			     const int* multiplicity, int n) {
+  // a sum of per class hashes doesn't depend on the order
+  uint64_t sum = mix(n);
+  for (int c = 0; c < n; c++) {
+    uint64_t weight_bits;
+    std::memcpy(&weight_bits, &weights[c], sizeof(weight_bits));
+    sum += mix(mix((uint64_t) paths[c] << 32 | (uint32_t) multiplicity[c]) ^ weight_bits);
+  }
+  return sum;
+}
+
+bool RateMemo::lookup(uint64_t key, const int* paths, const double* weights,
+		      const int* multiplicity, int n, double* rates) {
+  auto it = by_key.find(key);
+  if (it == by_key.end() or (int) it->second->paths.size() != n) {
+    num_misses++;
+    return false;
+  }
+  // the classes are distinct, so n of them all found with the same
+  // multiplicity is the same multiset
+  const Entry& e = *it->second;
+  for (int c = 0; c < n; c++) {
+    auto first = e.paths.begin(), last = e.paths.end();
+    auto at = std::lower_bound(first, last, paths[c]);
+    int i = at - first;
+    while (i < n and e.paths[i] == paths[c] and e.weights[i] < weights[c]) i++;
+    if (i == n or e.paths[i] != paths[c] or e.weights[i] != weights[c]
+	or e.multiplicity[i] != multiplicity[c]) {
+      num_misses++;
+      return false;
+    }
+    rates[c] = e.rates[i];
+  }
+  entries.splice(entries.begin(), entries, it->second);
+  num_hits++;
+  return true;
+}
+
+void RateMemo::insert(uint64_t key, const int* paths, const double* weights,
+		      const int* multiplicity, int n, const double* rates) {
+  size_t entry_bytes = sizeof(Entry) + n * (2 * sizeof(int) + 2 * sizeof(double));
+  if (entry_bytes > max_bytes) return;
+  // a different set with the same key makes way
+  auto old = by_key.find(key);
+  if (old != by_key.end()) {
+    bytes -= old->second->bytes;
+    entries.erase(old->second);
+    by_key.erase(old);
+  }
+  while (bytes + entry_bytes > max_bytes) {
+    bytes -= entries.back().bytes;
+    by_key.erase(entries.back().key);
+    entries.pop_back();
+    num_evictions++;
+  }
+  order.resize(n);
+  for (int c = 0; c < n; c++) order[c] = c;
+  std::sort(order.begin(), order.end(), [&](int a, int b) {
+      return paths[a] < paths[b] or (paths[a] == paths[b] and weights[a] < weights[b]);
+    });
+  entries.emplace_front();
+  Entry& e = entries.front();
+  e.key = key;
+  e.bytes = entry_bytes;
+  e.paths.resize(n);
+  e.weights.resize(n);
+  e.multiplicity.resize(n);
+  e.rates.resize(n);
+  for (int i = 0; i < n; i++) {
+    int c = order[i];
+    e.paths[i] = paths[c];
+    e.weights[i] = weights[c];
+    e.multiplicity[i] = multiplicity[c];
+    e.rates[i] = rates[c];
+  }
+  by_key[key] = entries.begin();
+  bytes += entry_bytes;
+}
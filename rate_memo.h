@@ -0,0 +1,60 @@
+#ifndef RATE_MEMO_H
+#define RATE_MEMO_H
+
+#include <cstdint>
+#include <cstddef>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+// Remembers solved allocations by the set of flow classes that was
+// solved, for workloads that keep coming back to the same active set
+// (an incast every epoch, a CT trace's repeating phases). A class is a
+// (path id, weight) pair with the number of flows in it; the key is
+// their multiset, hashed so the order flows come in doesn't matter, and
+// a hit is only taken if every class matches. Held in at most max_bytes,
+// the least recently used allocation goes first.
+class RateMemo {
+ protected:
+  struct Entry {
+    uint64_t key;
+    // classes in canonical order, (path, weight) ascending
+    std::vector< int > paths;
+    std::vector< double > weights;
+    std::vector< int > multiplicity;
+    std::vector< double > rates; // of one flow of the class
+    size_t bytes;
+  };
+  std::list< Entry > entries; // most recently used first
+  std::unordered_map< uint64_t, std::list< Entry >::iterator > by_key;
+  size_t max_bytes;
+  size_t bytes = 0;
+  long num_hits = 0;
+  long num_misses = 0;
+  long num_evictions = 0;
+
+  std::vector< int > order; // scratch for insert
+
+ public:
+  explicit RateMemo(size_t max_bytes) : max_bytes(max_bytes) {}
+
+  // order-independent hash of the n classes
+  static uint64_t signature(const int* paths, const double* weights,
+			    const int* multiplicity, int n);
+  // sets rates[c] for every class c if the same classes were solved
+  // before. classes have to be distinct (path, weight) pairs
+  bool lookup(uint64_t key, const int* paths, const double* weights,
+	      const int* multiplicity, int n, double* rates);
+  // remembers the rates of a solve lookup() missed, evicting as needed.
+  // an allocation bigger than max_bytes isn't kept
+  void insert(uint64_t key, const int* paths, const double* weights,
+	      const int* multiplicity, int n, const double* rates);
+
+  long get_num_hits() const { return num_hits; }
+  long get_num_misses() const { return num_misses; }
+  long get_num_evictions() const { return num_evictions; }
+  size_t get_num_entries() const { return entries.size(); }
+  size_t get_bytes() const { return bytes; }
+};
+
+#endif
@@ -0,0 +1,90 @@
+#include "rate_snapshot.h"
+#include <iostream>
+#include <cstdlib>
+#include <algorithm>
+
+void RateSnapshot::fill(const FlowTable& flows, long version, double time) {
+  this->version = version;
+  this->time = time;
+  num_flows_ = flows.num_active();
+  size_t size = 64;
+  while (size < 2 * (size_t) num_flows_) size *= 2;
+  // keep what a bigger solve left behind, the snapshot is reused
+  keys.assign(std::max(size, keys.size()), -1);
+  rates.resize(keys.size());
+  mask = keys.size() - 1;
+  for (int slot = 0; slot < flows.num_slots(); slot++) {
+    if (not flows.in_use(slot)) continue;
+    int flow = flows.flow_id[slot];
+    size_t i = hash_of(flow);
+    while (keys[i] >= 0) i = (i + 1) & mask;
+    keys[i] = flow;
+    rates[i] = flows.rate[slot];
+  }
+}
+
+RateSnapshots::RateSnapshots(int max_readers)
+  : max_readers(max_readers), readers(new ReaderSlot[max_readers]),
+    current(new RateSnapshot()), epoch(1) {
+  for (int r = 0; r < max_readers; r++) {
+    readers[r].epoch.store(0);
+    readers[r].taken.store(false);
+  }
+}
+
+RateSnapshots::~RateSnapshots() {
+  delete current.load();
+  for (auto& es : retired) delete es.second;
+  for (auto s : spare) delete s;
+}
+
+int RateSnapshots::register_reader() {
+  for (int r = 0; r < max_readers; r++) {
+    bool taken = false;
+    if (readers[r].taken.compare_exchange_strong(taken, true)) return r;
+  }
+  return -1;
+}
+
+void RateSnapshots::unregister_reader(int reader) {
+  if (reader < 0 or reader >= max_readers or not readers[reader].taken.load()) {
+    std::cerr << "unregistering unknown reader " << reader << std::endl;
+    exit(1);
+  }
+  readers[reader].epoch.store(0);
+  readers[reader].taken.store(false);
+}
+
+void RateSnapshots::publish(const FlowTable& flows, double time) {
+  RateSnapshot* snapshot;
+  if (spare.size() > 0) {
+    snapshot = spare.back();
+    spare.pop_back();
+  } else {
+    snapshot = new RateSnapshot();
+  }
+  snapshot->fill(flows, ++next_version, time);
+
+  // readers that pin from here on see the new snapshot. one that read
+  // the epoch before the increment may still be on the old one
+  const RateSnapshot* old = current.exchange(snapshot);
+  uint64_t replaced_in = epoch.fetch_add(1);
+  retired.push_back(std::make_pair(replaced_in, const_cast<RateSnapshot*>(old)));
+  reclaim();
+}
+
+void RateSnapshots::reclaim() {
+  // oldest epoch a reader is pinned in, a snapshot replaced in an
+  // earlier epoch can't be pinned by anyone any more
+  uint64_t oldest = epoch.load();
+  for (int r = 0; r < max_readers; r++) {
+    uint64_t e = readers[r].epoch.load();
+    if (e != 0 and e < oldest) oldest = e;
+  }
+  size_t kept = 0;
+  for (size_t i = 0; i < retired.size(); i++) {
+    if (retired[i].first < oldest) spare.push_back(retired[i].second);
+    else retired[kept++] = retired[i];
+  }
+  retired.resize(kept);
+}
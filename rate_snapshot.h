@@ -0,0 +1,120 @@
+#ifndef RATE_SNAPSHOT_H
+#define RATE_SNAPSHOT_H
+
+#include "flow_table.h"
+#include <atomic>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+// The rates of one solve. Never changed while published, readers can
+// look up as many flows as they like and they all come from one solve.
+class RateSnapshot {
+  friend class RateSnapshots;
+ protected:
+  long version = 0;
+  double time = 0;
+  int num_flows_ = 0;
+  // flow id -> rate, linear probing, -1 is an empty key
+  std::vector< int > keys;
+  std::vector< double > rates;
+  size_t mask = 0;
+
+  size_t hash_of(int flow) const { return ((unsigned) flow * 2654435761u) & mask; }
+  void fill(const FlowTable& flows, long version, double time);
+
+ public:
+  // Gb/s, -1 if the flow wasn't active in this solve
+  double rate(int flow_id) const {
+    for (size_t i = hash_of(flow_id); keys[i] >= 0; i = (i + 1) & mask) {
+      if (keys[i] == flow_id) return rates[i];
+    }
+    return -1;
+  }
+  // counts up by one with every publish, 0 before the first
+  long get_version() const { return version; }
+  double get_time() const { return time; }
+  int num_flows() const { return num_flows_; }
+  // calls fn(flow_id, rate) for every flow, in no particular order
+  template <class Fn>
+  void for_each(Fn fn) const {
+    for (size_t i = 0; i < keys.size(); i++) {
+      if (keys[i] >= 0) fn(keys[i], rates[i]);
+    }
+  }
+};
+
+// Read-copy-update rate table. One writer (the engine) fills a fresh
+// snapshot after every solve and swaps it in with one atomic store, any
+// number of reader threads pin the current snapshot and read from it
+// without locks or waiting. Snapshots are reclaimed by epoch: a reader
+// announces the epoch it pinned in, and a replaced snapshot is only
+// reused once every reader is idle or pinned after it was replaced.
+// A reader that stays pinned just holds old snapshots back, it never
+// holds up the writer.
+class RateSnapshots {
+ protected:
+  // one per reader, padded to its own cache line
+  struct ReaderSlot {
+    std::atomic< uint64_t > epoch; // 0 when not pinned
+    std::atomic< bool > taken;
+    char pad[64 - sizeof(std::atomic< uint64_t >) - sizeof(std::atomic< bool >)];
+  };
+
+  int max_readers;
+  std::unique_ptr< ReaderSlot[] > readers;
+  std::atomic< const RateSnapshot* > current;
+  std::atomic< uint64_t > epoch;
+
+  // writer only: replaced snapshots with the epoch they were replaced
+  // in, and reclaimed ones to fill next
+  std::vector< std::pair< uint64_t, RateSnapshot* > > retired;
+  std::vector< RateSnapshot* > spare;
+  long next_version = 0;
+
+  void reclaim();
+
+ public:
+  explicit RateSnapshots(int max_readers = 64);
+  // no reader may still be registered
+  ~RateSnapshots();
+  RateSnapshots(const RateSnapshots&) = delete;
+  RateSnapshots& operator=(const RateSnapshots&) = delete;
+
+  // writer side, from one thread: copies the rates of the active flows
+  // into a new snapshot and makes it the current one
+  void publish(const FlowTable& flows, double time);
+  // snapshots published, waiting to be reclaimed and ready for reuse
+  long num_published() const { return next_version; }
+  size_t num_retired() const { return retired.size(); }
+  size_t num_spare() const { return spare.size(); }
+
+  // reader side. a reader id is for one thread at a time,
+  // -1 if max_readers are registered already
+  int register_reader();
+  void unregister_reader(int reader);
+  // the current snapshot, valid until the reader's unpin()
+  const RateSnapshot* pin(int reader) {
+    ReaderSlot& slot = readers[reader];
+    slot.epoch.store(epoch.load());
+    return current.load();
+  }
+  void unpin(int reader) { readers[reader].epoch.store(0); }
+};
+
+// pins a reader's snapshot for a scope
+class PinnedSnapshot {
+  RateSnapshots& snapshots;
+  int reader;
+  const RateSnapshot* snapshot;
+ public:
+  PinnedSnapshot(RateSnapshots& snapshots, int reader)
+    : snapshots(snapshots), reader(reader), snapshot(snapshots.pin(reader)) {}
+  ~PinnedSnapshot() { snapshots.unpin(reader); }
+  PinnedSnapshot(const PinnedSnapshot&) = delete;
+  PinnedSnapshot& operator=(const PinnedSnapshot&) = delete;
+  const RateSnapshot& operator*() const { return *snapshot; }
+  const RateSnapshot* operator->() const { return snapshot; }
+};
+
+#endif
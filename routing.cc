@@ -0,0 +1,85 @@
+#include "routing.h"
+#include <iostream>
+#include <deque>
+#include <algorithm>
+#include <cstdint>
+
+RouteTable::RouteTable(const Topology& topology,
+		       PathTable& paths, int max_ecmp_paths)
+  : topology(topology), paths(paths), max_ecmp_paths(max_ecmp_paths) {}
+
+const std::vector< int >& RouteTable::get_hops_to(int dst) {
+  auto it = hops_to_dst.find(dst);
+  if (it != hops_to_dst.end()) return it->second;
+
+  // bfs backwards from dst
+  std::vector< int >& hops = hops_to_dst[dst];
+  hops.assign(topology.num_nodes(), -1);
+  std::deque< int > queue;
+  hops.at(dst) = 0;
+  queue.push_back(dst);
+  while (queue.size() > 0) {
+    int node = queue.front();
+    queue.pop_front();
+    for (const int32_t* l = topology.in_begin(node); l != topology.in_end(node); l++) {
+      int prev = topology.link_src(*l);
+      if (hops.at(prev) < 0) {
+	hops.at(prev) = hops.at(node) + 1;
+	queue.push_back(prev);
+      }
+    }
+  }
+  return hops;
+}
+
+void RouteTable::add_paths_from(int node, const std::vector< int >& hops,
+				std::vector< link_t >& path,
+				std::vector< int >& found) {
+  if (hops.at(node) == 0) {
+    found.push_back(paths.intern(path));
+    return;
+  }
+  // out links are sorted by dst, so routes are the same every run
+  for (const int32_t* l = topology.out_begin(node); l != topology.out_end(node); l++) {
+    if ((int) found.size() >= max_ecmp_paths) return;
+    int next = topology.link_dst(*l);
+    if (hops.at(next) != hops.at(node) - 1) continue;
+    path.push_back(std::make_pair(node, next));
+    add_paths_from(next, hops, path, found);
+    path.pop_back();
+  }
+}
+
+const std::vector< int >& RouteTable::get_routes(int src, int dst) {
+  auto key = std::make_pair(src, dst);
+  auto it = routes.find(key);
+  if (it != routes.end()) return it->second;
+
+  std::vector< int >& found = routes[key];
+  if (src < 0 or dst < 0 or src == dst
+      or src >= topology.num_nodes() or dst >= topology.num_nodes()) {
+    return found;
+  }
+  const std::vector< int >& hops = get_hops_to(dst);
+  if (hops.at(src) < 0) return found;
+  std::vector< link_t > path;
+  add_paths_from(src, hops, path, found);
+  return found;
+}
+
+// the 64 bit finalizer of splitmix64, so flow ids that follow each
+// other land on paths as if hashed rather than in turn
+static uint64_t mix(uint64_t x) {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  return x;
+}
+
+int RouteTable::route(int src, int dst, unsigned hash) {
+  const std::vector< int >& found = get_routes(src, dst);
+  if (found.size() == 0) return -1;
+  return found.at(mix(hash) % found.size());
+}
@@ -0,0 +1,37 @@
+#ifndef ROUTING_H
+#define ROUTING_H
+
+#include "path_table.h"
+#include "topology.h"
+#include <map>
+#include <vector>
+
+// Shortest paths over the topology's links, so trace lines
+// can give just src and dst. All equal cost (fewest hops) paths between
+// a pair are found once and cached as path ids in the path table, a
+// flow's hash picks one of them like ECMP would.
+class RouteTable {
+ protected:
+  const Topology& topology;
+  PathTable& paths;
+  int max_ecmp_paths;
+  std::map< int, std::vector< int > > hops_to_dst; // dst -> hops from each node, -1 if unreachable
+  std::map< std::pair< int, int >, std::vector< int > > routes; // (src, dst) -> path ids
+
+  const std::vector< int >& get_hops_to(int dst);
+  void add_paths_from(int node, const std::vector< int >& hops,
+		      std::vector< link_t >& path, std::vector< int >& found);
+
+ public:
+  RouteTable(const Topology& topology,
+	     PathTable& paths = PathTable::global(),
+	     int max_ecmp_paths = 64);
+  // path ids of the equal cost paths from src to dst, empty if there are none
+  const std::vector< int >& get_routes(int src, int dst);
+  // path id for a flow from src to dst, -1 if dst can't be reached.
+  // hash (the flow id in the simulators) is mixed before it picks a
+  // path, so consecutive ids don't take the paths round robin
+  int route(int src, int dst, unsigned hash = 0);
+};
+
+#endif
@@ -0,0 +1,18 @@
+# example ./run_quantum.sh 1e-6
+# input_for_quantum/off-grid-flows.txt starts flows at 0.001407, which
+# isn't a whole number of quanta; every flow should still finish
+QUANTUM=${1:-1e-6}
+INPUT=input_for_quantum/off-grid-flows.txt
+timeout 60 ./wsim $INPUT quantum-out.txt links-100.txt 1000000 1 1.0 --quantum=${QUANTUM} 1> quantum-tmp.out 2> quantum-tmp.err
+status=$?
+if [ $status -ne 0 ]; then
+  echo "wsim --quantum=${QUANTUM} failed with status $status (124 is a timeout)"
+  exit 1
+fi
+expected=$(wc -l < $INPUT)
+finished=$(wc -l < quantum-out.txt)
+if [ "$finished" -ne "$expected" ]; then
+  echo "$finished of $expected flows finished with --quantum=${QUANTUM}"
+  exit 1
+fi
+echo "all $expected flows finished with --quantum=${QUANTUM}"
@@ -1,3 +1,10 @@
-g++ -g -std=c++14 -o wsim ideal_simulator.cc weighted_waterfilling.cc
-g++ -g -std=c++14 -o wsim-ct ideal_ct.cc weighted_waterfilling.cc
+g++ -g -std=c++14 -pthread -o wsim ideal_simulator.cc trace_simulator.cc options.cc fct_stats.cc kll_sketch.cc waterfilling_engine.cc weighted_waterfilling.cc tree_waterfilling.cc approx_waterfilling.cc rate_memo.cc link_stats.cc bottleneck_stats.cc path_table.cc routing.cc topology.cc flow_table.cc rate_snapshot.cc what_if.cc
+g++ -g -std=c++14 -pthread -o wsim-ct ideal_ct.cc trace_simulator.cc options.cc fct_stats.cc kll_sketch.cc waterfilling_engine.cc weighted_waterfilling.cc tree_waterfilling.cc approx_waterfilling.cc rate_memo.cc link_stats.cc bottleneck_stats.cc path_table.cc routing.cc topology.cc flow_table.cc rate_snapshot.cc what_if.cc
+g++ -g -std=c++14 -o wtopo compile_topology.cc topology.cc
+g++ -g -std=c++14 -pthread -o wfd wf_daemon.cc waterfilling_engine.cc weighted_waterfilling.cc tree_waterfilling.cc approx_waterfilling.cc rate_memo.cc link_stats.cc bottleneck_stats.cc path_table.cc routing.cc topology.cc flow_table.cc rate_snapshot.cc what_if.cc
+g++ -g -std=c++14 -o wfload wf_loadgen.cc
+g++ -g -std=c++14 -pthread -o wbatch batch_bench.cc batch_waterfilling.cc weighted_waterfilling.cc tree_waterfilling.cc rate_memo.cc path_table.cc routing.cc topology.cc
 
+g++ -g -std=c++14 -pthread -fPIC -c wf_api.cc waterfilling_engine.cc weighted_waterfilling.cc tree_waterfilling.cc approx_waterfilling.cc rate_memo.cc link_stats.cc bottleneck_stats.cc path_table.cc routing.cc topology.cc flow_table.cc rate_snapshot.cc what_if.cc
+ar rcs libwaterfilling.a wf_api.o waterfilling_engine.o weighted_waterfilling.o tree_waterfilling.o approx_waterfilling.o rate_memo.o link_stats.o bottleneck_stats.o path_table.o routing.o topology.o flow_table.o rate_snapshot.o what_if.o
+g++ -shared -pthread -o libwaterfilling.so wf_api.o waterfilling_engine.o weighted_waterfilling.o tree_waterfilling.o approx_waterfilling.o rate_memo.o link_stats.o bottleneck_stats.o path_table.o routing.o topology.o flow_table.o rate_snapshot.o what_if.o
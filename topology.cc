@@ -0,0 +1,215 @@
+#include "topology.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <algorithm>
+#include <limits>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+const char Topology::snapshot_magic[8] = {'W', 'F', 'T', 'O', 'P', 'O', '1', '\0'};
+
+Topology::~Topology() {
+  if (mapped) munmap(mapped, mapped_size);
+}
+
+size_t Topology::snapshot_size(int num_nodes, int num_links) {
+  return sizeof(SnapshotHeader) + num_links * sizeof(double)
+    + (4 * (size_t) num_links + 2 * ((size_t) num_nodes + 1)) * sizeof(int32_t);
+}
+
+void Topology::point_into(const char* base) {
+  const char* p = base;
+  capacities_ = (const double*) p; p += num_links_ * sizeof(double);
+  link_src_ = (const int32_t*) p; p += num_links_ * sizeof(int32_t);
+  link_dst_ = (const int32_t*) p; p += num_links_ * sizeof(int32_t);
+  out_offsets_ = (const int32_t*) p; p += (num_nodes_ + 1) * sizeof(int32_t);
+  out_links_ = (const int32_t*) p; p += num_links_ * sizeof(int32_t);
+  in_offsets_ = (const int32_t*) p; p += (num_nodes_ + 1) * sizeof(int32_t);
+  in_links_ = (const int32_t*) p;
+}
+
+void Topology::build(const std::map< link_t, double >& link_capacities) {
+  num_links_ = link_capacities.size();
+  num_nodes_ = 0;
+  for (const auto& l : link_capacities) {
+    // nodes are numbered 0..num_nodes-1 and index the offset arrays
+    int lowest = std::min(l.first.first, l.first.second);
+    int highest = std::max(l.first.first, l.first.second);
+    if (lowest < 0 or highest >= std::numeric_limits<int32_t>::max()) {
+      std::cerr << "Unable to build topology, link " << l.first.first << "-" << l.first.second
+		<< " has a node id outside 0.." << std::numeric_limits<int32_t>::max() - 1
+		<< std::endl;
+      exit(1);
+    }
+    num_nodes_ = std::max(num_nodes_, highest + 1);
+  }
+
+  // same layout as a snapshot minus the header, so point_into works for both
+  owned_capacities.resize(num_links_);
+  owned_ints.assign(4 * num_links_ + 2 * (num_nodes_ + 1), 0);
+  int32_t* src = owned_ints.data();
+  int32_t* dst = src + num_links_;
+  int32_t* out_offsets = dst + num_links_;
+  int32_t* out_links = out_offsets + num_nodes_ + 1;
+  int32_t* in_offsets = out_links + num_links_;
+  int32_t* in_links = in_offsets + num_nodes_ + 1;
+
+  int id = 0;
+  for (const auto& l : link_capacities) {
+    owned_capacities[id] = l.second;
+    src[id] = l.first.first;
+    dst[id] = l.first.second;
+    out_offsets[l.first.first + 1]++;
+    in_offsets[l.first.second + 1]++;
+    id++;
+  }
+  for (int n = 0; n < num_nodes_; n++) {
+    out_offsets[n + 1] += out_offsets[n];
+    in_offsets[n + 1] += in_offsets[n];
+  }
+  // ids are in (src, dst) order so out links come out sorted by dst,
+  // in links sorted by src
+  std::vector< int32_t > out_next(out_offsets, out_offsets + num_nodes_);
+  std::vector< int32_t > in_next(in_offsets, in_offsets + num_nodes_);
+  for (id = 0; id < num_links_; id++) {
+    out_links[out_next[src[id]]++] = id;
+  }
+  for (id = 0; id < num_links_; id++) {
+    in_links[in_next[dst[id]]++] = id;
+  }
+
+  capacities_ = owned_capacities.data();
+  link_src_ = src;
+  link_dst_ = dst;
+  out_offsets_ = out_offsets;
+  out_links_ = out_links;
+  in_offsets_ = in_offsets;
+  in_links_ = in_links;
+}
+
+std::unique_ptr<Topology> Topology::from_capacities(const std::map< link_t, double >& link_capacities) {
+  std::unique_ptr<Topology> topology(new Topology());
+  topology->build(link_capacities);
+  return topology;
+}
+
+std::unique_ptr<Topology> Topology::from_link_file(const std::string& filename) {
+  std::ifstream link_file(filename);
+  if (not link_file.is_open()) {
+    std::cerr << "Unable to open file " << filename << std::endl;
+    exit(1);
+  }
+  std::string line;
+  std::map<link_t, double > link_capacities;
+  while (getline (link_file,line)) {
+    std::string buf1;
+    std::string buf2;
+    std::string buf3;
+    std::stringstream ss(line);
+    if (ss >> buf1 and ss >> buf2 and ss >> buf3) {
+      int node1 = atoi(buf1.c_str());
+      int node2 = atoi(buf2.c_str());
+      double cap = atof(buf3.c_str());
+      link_capacities[std::make_pair(node1, node2)] = cap;
+    } else {
+      std::cerr << "can't parse " << line << " to get link and cap\n";
+    }
+  }
+  return from_capacities(link_capacities);
+}
+
+std::unique_ptr<Topology> Topology::from_snapshot(const std::string& filename) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    std::cerr << "Unable to open file " << filename << std::endl;
+    exit(1);
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 or (size_t) st.st_size < sizeof(SnapshotHeader)) {
+    std::cerr << "topology snapshot " << filename << " is truncated\n";
+    exit(1);
+  }
+  void* mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED) {
+    std::cerr << "couldn't mmap topology snapshot " << filename << std::endl;
+    exit(1);
+  }
+
+  std::unique_ptr<Topology> topology(new Topology());
+  topology->mapped = mapped;
+  topology->mapped_size = st.st_size;
+  const SnapshotHeader* header = (const SnapshotHeader*) mapped;
+  if (memcmp(header->magic, snapshot_magic, sizeof(snapshot_magic)) != 0
+      or header->num_nodes < 0 or header->num_links < 0
+      or header->file_size != (int64_t) st.st_size
+      or snapshot_size(header->num_nodes, header->num_links) != (size_t) st.st_size) {
+    std::cerr << filename << " is not a valid topology snapshot\n";
+    exit(1);
+  }
+  topology->num_nodes_ = header->num_nodes;
+  topology->num_links_ = header->num_links;
+  topology->point_into((const char*) mapped + sizeof(SnapshotHeader));
+  for (int l = 0; l < topology->num_links_; l++) {
+    int src = topology->link_src_[l], dst = topology->link_dst_[l];
+    if (src < 0 or src >= topology->num_nodes_ or dst < 0 or dst >= topology->num_nodes_) {
+      std::cerr << "Unable to load topology snapshot " << filename << ", link " << l
+		<< " has a node id outside 0.." << topology->num_nodes_ - 1 << std::endl;
+      exit(1);
+    }
+  }
+  return topology;
+}
+
+std::unique_ptr<Topology> Topology::load(const std::string& filename) {
+  char magic[sizeof(snapshot_magic)] = {0};
+  std::ifstream file(filename, std::ios::binary);
+  if (not file.is_open()) {
+    std::cerr << "Unable to open file " << filename << std::endl;
+    exit(1);
+  }
+  file.read(magic, sizeof(magic));
+  file.close();
+  if (memcmp(magic, snapshot_magic, sizeof(snapshot_magic)) == 0) {
+    return from_snapshot(filename);
+  }
+  return from_link_file(filename);
+}
+
+bool Topology::write_snapshot(const std::string& filename) const {
+  std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+  if (not out.is_open()) {
+    std::cerr << "Unable to open file " << filename << std::endl;
+    return false;
+  }
+  SnapshotHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, snapshot_magic, sizeof(snapshot_magic));
+  header.num_nodes = num_nodes_;
+  header.num_links = num_links_;
+  header.file_size = snapshot_size(num_nodes_, num_links_);
+  out.write((const char*) &header, sizeof(header));
+  out.write((const char*) capacities_, num_links_ * sizeof(double));
+  out.write((const char*) link_src_, num_links_ * sizeof(int32_t));
+  out.write((const char*) link_dst_, num_links_ * sizeof(int32_t));
+  out.write((const char*) out_offsets_, (num_nodes_ + 1) * sizeof(int32_t));
+  out.write((const char*) out_links_, num_links_ * sizeof(int32_t));
+  out.write((const char*) in_offsets_, (num_nodes_ + 1) * sizeof(int32_t));
+  out.write((const char*) in_links_, num_links_ * sizeof(int32_t));
+  return out.good();
+}
+
+int Topology::link_id(int node1, int node2) const {
+  // links are sorted by (src, dst), search node1's out links
+  if (node1 < 0 or node1 >= num_nodes_) return -1;
+  const int32_t* first = out_begin(node1);
+  const int32_t* last = out_end(node1);
+  const int32_t* it = std::lower_bound(first, last, node2,
+				       [this](int32_t link, int node) { return link_dst_[link] < node; });
+  if (it == last or link_dst_[*it] != node2) return -1;
+  return *it;
+}
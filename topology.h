@@ -0,0 +1,89 @@
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include <map>
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include <utility> // std::pair
+typedef std::pair<int, int> link_t;
+
+// Links with dense ids 0..num_links-1, numbered in (node1, node2) order,
+// so the sorted endpoint arrays double as the node pair -> link id index.
+// out_links/in_links are the adjacency in CSR form: the links leaving
+// node n are out_links[out_offsets[n]] .. out_links[out_offsets[n+1]-1].
+//
+// A topology is either parsed from a text link file or mapped read-only
+// from a binary snapshot written by write_snapshot (see compile_topology.cc),
+// in which case every simulator using the snapshot shares one copy
+// through the page cache.
+class Topology {
+ public:
+  static const char snapshot_magic[8];
+
+ protected:
+  // snapshot layout, the arrays follow the header in this order:
+  // capacities (double), link_src, link_dst, out_offsets, out_links,
+  // in_offsets, in_links (all int32)
+  struct SnapshotHeader {
+    char magic[8];
+    int32_t num_nodes;
+    int32_t num_links;
+    int64_t file_size;
+  };
+
+  int num_nodes_ = 0;
+  int num_links_ = 0;
+  const double* capacities_ = nullptr;
+  const int32_t* link_src_ = nullptr;
+  const int32_t* link_dst_ = nullptr;
+  const int32_t* out_offsets_ = nullptr;
+  const int32_t* out_links_ = nullptr;
+  const int32_t* in_offsets_ = nullptr;
+  const int32_t* in_links_ = nullptr;
+
+  // backing storage when we built the arrays ourselves
+  std::vector< double > owned_capacities;
+  std::vector< int32_t > owned_ints;
+  // or the mapped snapshot
+  void* mapped = nullptr;
+  size_t mapped_size = 0;
+
+  Topology() {}
+  void build(const std::map< link_t, double >& link_capacities);
+  static size_t snapshot_size(int num_nodes, int num_links);
+  void point_into(const char* base);
+
+ public:
+  ~Topology();
+  Topology(const Topology&) = delete;
+  Topology& operator=(const Topology&) = delete;
+
+  static std::unique_ptr<Topology> from_capacities(const std::map< link_t, double >& link_capacities);
+  // text file with "node1 node2 capacity" lines
+  static std::unique_ptr<Topology> from_link_file(const std::string& filename);
+  static std::unique_ptr<Topology> from_snapshot(const std::string& filename);
+  // snapshot if the file starts with snapshot_magic, text link file otherwise
+  static std::unique_ptr<Topology> load(const std::string& filename);
+  bool write_snapshot(const std::string& filename) const;
+
+  int num_nodes() const { return num_nodes_; }
+  int num_links() const { return num_links_; }
+  link_t get_link(int link) const { return std::make_pair((int) link_src_[link], (int) link_dst_[link]); }
+  double capacity(int link) const { return capacities_[link]; }
+  // dense id of the link node1->node2, -1 if there isn't one
+  int link_id(int node1, int node2) const;
+  int link_id(const link_t& link) const { return link_id(link.first, link.second); }
+
+  const int32_t* out_begin(int node) const { return out_links_ + out_offsets_[node]; }
+  const int32_t* out_end(int node) const { return out_links_ + out_offsets_[node + 1]; }
+  const int32_t* in_begin(int node) const { return in_links_ + in_offsets_[node]; }
+  const int32_t* in_end(int node) const { return in_links_ + in_offsets_[node + 1]; }
+  int link_src(int link) const { return link_src_[link]; }
+  int link_dst(int link) const { return link_dst_[link]; }
+  bool is_mapped() const { return mapped != nullptr; }
+};
+
+#endif
@@ -0,0 +1,401 @@
+#include "trace_simulator.h"
+#include "checkpoint.h"
+#include <iomanip>
+#include <algorithm>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#ifdef WF_COUNT_ALLOCS
+#include "alloc_count.h"
+#endif
+
+TraceSimulator::TraceSimulator(const std::string& flow_filename,
+			       const std::string& out_filename,
+			       const std::string& link_filename,
+			       double min_bytes_for_priority,
+			       double priority_weight,
+			       double max_sim_time,
+			       bool restoring):
+  flow_filename(flow_filename), out_filename(out_filename), link_filename(link_filename),
+  min_bytes_for_priority_(min_bytes_for_priority), priority_weight_(priority_weight),
+  max_sim_time_(max_sim_time), flow_file(flow_filename) {
+  if (not flow_file.is_open()) {
+    std::cerr << "Unable to open file " << flow_filename << std::endl;
+    exit(1);
+  }
+  if (not restoring) out_file.open(out_filename);
+  if (not restoring and not out_file.is_open()) {
+    std::cerr << "Unable to open file " << out_filename << std::endl;
+    exit(1);
+  }
+  if (max_sim_time_ <= 0) {
+    std::cerr << "invalid max_sim_time " << max_sim_time_ << std::endl;
+    exit(1);
+  }
+
+  // parse link filename (or map a topology snapshot) and initialize wf
+  topology = Topology::load(link_filename);
+  std::cout << "set up " << topology->num_links() << " links"
+	    << (topology->is_mapped() ? " from snapshot" : "") << ".\n";
+  engine = std::make_unique<WaterfillingEngine>(*topology, paths);
+  // fct records are written as flows finish
+  engine->on_finish = [this](const FinishedFlow& flow) { write_fct(flow); };
+}
+
+TraceSimulator::~TraceSimulator() {
+  if (flow_file.is_open()) flow_file.close();
+  if (out_file.is_open()) out_file.close();
+}
+
+void TraceSimulator::drain_until(double time) {
+  DrainStatus status = engine->drain_until(time);
+  if (status == DrainStatus::time_went_back) {
+    std::cerr << "can't drain back to " << time << " at curr_time "
+	      << engine->get_time() << std::endl;
+    exit(1);
+  }
+  if (status == DrainStatus::past_finish) {
+    std::cerr << "flow " << engine->get_drain_error_flow()
+	      << " was drained past its finish on the way to " << time << std::endl;
+    exit(1);
+  }
+}
+
+void TraceSimulator::write_fct(const FinishedFlow& flow) {
+  double fldur = flow.end - flow.start;
+  int src = paths.front(flow.path).first;
+  int dst = paths.back(flow.path).second;
+#ifdef WF_COUNT_ALLOCS
+  // the sketches keep growing with every flow, the replay leaves them be
+  if (fct_stats and not replaying) fct_stats->add(flow.path, flow.size, fldur);
+#else
+  if (fct_stats) fct_stats->add(flow.path, flow.size, fldur);
+#endif
+  flow_finished(flow, fldur);
+  if (not write_fcts) return;
+  out_file << "fid " << flow.flow_id
+	   << std::setprecision(12)
+	   << " end_time " << flow.end
+	   << " start_time " << flow.start
+	   << " fldur " << fldur
+	   << std::setprecision(5)
+	   << " num_bytes " << flow.size
+	   << " tmp_pkts "
+	   << std::round(flow.size/1460.0)
+	   << " gid "
+	   << src << "-" << dst;
+  write_fct_fields(flow);
+  if (engine->get_bottleneck_stats()) {
+    // the link that held the flow back longest
+    out_file << " bottleneck ";
+    if (flow.bottleneck < 0) out_file << "none";
+    else {
+      link_t link = topology->get_link(flow.bottleneck);
+      out_file << link.first << "-" << link.second;
+    }
+  }
+  out_file << "\n";
+}
+
+#ifdef WF_COUNT_ALLOCS
+size_t TraceSimulator::scratch_high_water() {
+  return engine->scratch_high_water()
+    + (fct_stats ? fct_stats->capacity_held() : 0)
+    + line.capacity() + path_buf.capacity();
+}
+
+void TraceSimulator::start_event_allocations() {
+  allocs_seen = num_heap_allocations();
+  high_water_seen = scratch_high_water();
+}
+
+void TraceSimulator::check_event_allocations() {
+  long allocs = num_heap_allocations();
+  size_t high_water = scratch_high_water();
+  if (allocs != allocs_seen) {
+    if (replaying or high_water == high_water_seen) {
+      std::cerr << "event at " << engine->get_time() << " made "
+		<< allocs - allocs_seen << " heap allocations"
+		<< (replaying ? " on the replay\n" : " without growing anything\n");
+      exit(1);
+    }
+    num_events_growing++;
+  }
+  allocs_seen = allocs;
+  high_water_seen = high_water;
+}
+
+void TraceSimulator::replay() {
+  if (engine->get_flows().num_active() > 0) {
+    std::cout << "not replaying, the run ended with "
+	      << engine->get_flows().num_active() << " active flows\n";
+    return;
+  }
+  double end = engine->get_time();
+  trace_time_offset = end;
+  max_sim_time_ += end;
+  checkpoint_file.clear();
+  write_fcts = false;
+  restored = false;
+  restored_events = 0;
+  replaying = true;
+  flow_file.clear();
+  flow_file.seekg(0);
+  rewind_trace();
+  std::cout << "replaying the trace from " << std::setprecision(12) << end << "\n";
+  run();
+}
+#endif
+
+void TraceSimulator::report(int num_events) {
+#ifdef WF_COUNT_ALLOCS
+  if (replaying) {
+    std::cout << "replayed " << num_events << " events without a heap allocation\n";
+    return;
+  }
+#endif
+  const ApproxWaterfilling* approx = engine->get_approx_solver();
+  // the approximate solver doesn't group flows into entities
+  if (not approx or engine->get_solver().get_num_flows_solved() > 0) {
+    std::cout << "solved " << engine->get_solver().get_num_flows_solved() << " flows as "
+	      << engine->get_solver().get_num_entities_solved() << " (path, weight) entities in "
+	      << num_events << " events\n";
+  }
+  if (approx) {
+    std::cout << "solved " << approx->get_num_flows_solved() << " flows approximately in "
+	      << num_events << " events\n";
+  }
+  std::cout << paths.num_paths() << " distinct paths interned\n";
+  size_t peak_active_flows = engine->get_peak_active_flows();
+  std::cout << "peak of " << peak_active_flows << " active flows\n";
+  if (engine->get_solver().get_num_tree_solves() > 0) {
+    std::cout << engine->get_solver().get_num_tree_solves() << " of "
+	      << engine->get_num_solves() << " solves on the tree solver\n";
+  }
+  if (approx) {
+    std::cout << approx->get_num_solves() << " approximate solves on "
+	      << approx->get_num_threads() << " threads, "
+	      << (double) approx->get_num_iterations() / std::max(1L, approx->get_num_solves())
+	      << " iterations per solve, worst bottleneck slack "
+	      << approx->get_worst_bottleneck_slack() << "\n";
+  }
+  const WeightedWaterfilling& wf = engine->get_solver();
+  if (wf.get_num_warm_hits() + wf.get_num_warm_misses() > 0) {
+    std::cout << "warm starts hit on " << wf.get_num_warm_hits() << " of "
+	      << wf.get_num_warm_hits() + wf.get_num_warm_misses() << " solves, "
+	      << 100.0 * wf.get_num_warm_flows_kept() / std::max(1L, wf.get_num_warm_flows())
+	      << "% of flows kept their rate\n";
+  }
+  if (const RateMemo* memo = wf.get_memo()) {
+    std::cout << "memo hit on " << memo->get_num_hits() << " of "
+	      << memo->get_num_hits() + memo->get_num_misses() << " solves, "
+	      << memo->get_num_evictions() << " evicted, "
+	      << memo->get_num_entries() << " held in " << memo->get_bytes() << " bytes\n";
+  }
+  if (engine->get_solver().get_num_links_pruned() > 0) {
+    std::cout << "pruned " << engine->get_solver().get_num_links_pruned() << " of "
+	      << engine->get_solver().get_num_links_solved() << " links solved\n";
+  }
+  // memory held at the end of the run, per flow at the peak
+  size_t per_flow = std::max(peak_active_flows, (size_t) 1);
+  size_t table_bytes = engine->get_flows().memory_bytes();
+  size_t scratch_bytes = engine->scratch_bytes();
+  std::cout << "flow table holds " << table_bytes << " bytes, "
+	    << table_bytes / per_flow << " per active flow, solver scratch "
+	    << scratch_bytes << " bytes, "
+	    << scratch_bytes / per_flow << " per active flow, "
+	    << (table_bytes + scratch_bytes) / per_flow << " per active flow in all\n";
+#ifdef WF_COUNT_ALLOCS
+  std::cout << "warm-up: " << num_events_growing << " of " << num_events
+	    << " events allocated, each while growing a table or buffer\n";
+#endif
+  simulator_report(num_events);
+}
+
+// set by SIGUSR1, the event loop checkpoints at the next event and clears it
+static volatile std::sig_atomic_t checkpoint_requested = 0;
+static void request_checkpoint(int) { checkpoint_requested = 1; }
+
+void TraceSimulator::set_fct_stats(const std::string& filename) {
+  fct_stats.reset(new FctStats(*topology, paths));
+  fct_stats_file = filename;
+}
+
+void TraceSimulator::set_checkpoints(const std::string& filename, double every) {
+  checkpoint_file = filename;
+  checkpoint_every = every;
+  next_checkpoint = std::max(engine->get_time(), 0.0) + every;
+  std::signal(SIGUSR1, request_checkpoint);
+}
+
+void TraceSimulator::maybe_checkpoint(int num_events) {
+  if (checkpoint_file.empty()) return;
+  double now = engine->get_time();
+  bool due = checkpoint_every > 0 and now >= next_checkpoint;
+  if (not due and not checkpoint_requested) return;
+  checkpoint_requested = 0;
+  save(checkpoint_file, num_events);
+  while (checkpoint_every > 0 and next_checkpoint <= now) next_checkpoint += checkpoint_every;
+}
+
+// rates are up to date between events (or saved stale with the engine
+// when events at one time are half applied), that's all a checkpoint
+// needs: the path table, the engine, the trace and output offsets and
+// the simulator's state. solver state (warm starts, memo) is rebuilt
+// after a restore
+void TraceSimulator::save(const std::string& filename, int num_events) {
+  // written aside and renamed over, a crash mid-write keeps the last one
+  std::string tmp = filename + ".tmp";
+  std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+  if (not out.is_open()) {
+    std::cerr << "Unable to open file " << tmp << std::endl;
+    exit(1);
+  }
+  out_file.flush();
+  out.write(checkpoint_magic, sizeof(checkpoint_magic));
+  checkpoint_put(out, std::string(checkpoint_kind()));
+  paths.save(out);
+  engine->save(out);
+  // -1 once the trace is used up
+  int64_t trace_offset = flow_file.good() ? (int64_t) flow_file.tellg() : -1;
+  checkpoint_put(out, trace_offset);
+  checkpoint_put(out, out_filename);
+  checkpoint_put(out, (int64_t) out_file.tellp());
+  checkpoint_put(out, num_events);
+  save_state(out);
+  out.close();
+  if (out.fail() or std::rename(tmp.c_str(), filename.c_str()) != 0) {
+    std::cerr << "couldn't write checkpoint " << filename << std::endl;
+    exit(1);
+  }
+  std::cout << "checkpoint at " << engine->get_time() << " to " << filename << "\n";
+}
+
+void TraceSimulator::restore(const std::string& filename) {
+  std::ifstream in(filename, std::ios::binary);
+  if (not in.is_open()) {
+    std::cerr << "Unable to open file " << filename << std::endl;
+    exit(1);
+  }
+  char magic[sizeof(checkpoint_magic)] = {0};
+  in.read(magic, sizeof(magic));
+  if (memcmp(magic, checkpoint_magic, sizeof(checkpoint_magic)) != 0) {
+    std::cerr << filename << " is not a checkpoint\n";
+    exit(1);
+  }
+  std::string simulator;
+  checkpoint_get(in, simulator);
+  if (not in.good() or simulator != checkpoint_kind()) {
+    std::cerr << filename << " is not a " << checkpoint_kind() << " checkpoint\n";
+    exit(1);
+  }
+  paths.restore(in);
+  engine->restore(in);
+  int64_t trace_offset, out_offset;
+  std::string saved_out;
+  checkpoint_get(in, trace_offset);
+  checkpoint_get(in, saved_out);
+  checkpoint_get(in, out_offset);
+  checkpoint_get(in, restored_events);
+  restore_state(in);
+  if (not in.good()) {
+    std::cerr << "checkpoint " << filename << " is truncated\n";
+    exit(1);
+  }
+
+  if (trace_offset >= 0) flow_file.seekg(trace_offset);
+  else flow_file.seekg(0, std::ios::end);
+
+  // the fcts up to the checkpoint carry over: cut back to them, or
+  // copied over when a variant writes somewhere else
+  if (saved_out == out_filename) {
+    if (truncate(out_filename.c_str(), out_offset) != 0) {
+      std::cerr << "couldn't cut " << out_filename << " back to " << out_offset << " bytes\n";
+      exit(1);
+    }
+    out_file.open(out_filename, std::ios::in | std::ios::out);
+    out_file.seekp(0, std::ios::end);
+  } else {
+    std::ifstream old(saved_out, std::ios::binary);
+    out_file.open(out_filename, std::ios::trunc);
+    if (not old.is_open()) {
+      std::cerr << "Unable to open file " << saved_out << std::endl;
+      exit(1);
+    }
+    std::vector< char > buf(1 << 20);
+    for (int64_t left = out_offset; left > 0; ) {
+      int64_t n = std::min(left, (int64_t) buf.size());
+      if (not old.read(buf.data(), n)) {
+	std::cerr << saved_out << " is shorter than the checkpoint says\n";
+	exit(1);
+      }
+      out_file.write(buf.data(), n);
+      left -= n;
+    }
+  }
+  if (not out_file.is_open()) {
+    std::cerr << "Unable to open file " << out_filename << std::endl;
+    exit(1);
+  }
+  restored = true;
+  std::cout << "restored " << filename << " at " << std::setprecision(12)
+	    << engine->get_time() << ", " << engine->get_flows().num_active()
+	    << " active flows\n";
+}
+
+void TraceSimulator::apply_options(const Options& options) {
+  if (options.has("tree")) {
+    engine->set_solver_mode(options.get("tree") == "force" ? SolverMode::tree
+			    : SolverMode::tree_if_detected);
+  }
+  engine->set_tree_check(options.has("tree-check"));
+  engine->set_link_pruning(options.has("prune-links"));
+  engine->set_warm_start(options.has("warm-start"));
+  // a restored run goes on with the checkpoint's integer time, the flag
+  // can only repeat it
+  if (not restored) {
+    engine->set_integer_time(options.has("integer-time"));
+  } else if (options.has("integer-time") and not engine->get_integer_time()) {
+    std::cerr << "--integer-time given but the checkpoint was saved without it\n";
+    exit(1);
+  }
+  if (options.has("checkpoint")) {
+    set_checkpoints(options.get("checkpoint"), options.get_double("checkpoint-every", 0));
+  }
+  if (options.has("memo")) {
+    engine->set_memo((size_t) (options.get_double("memo", 64) * 1024 * 1024));
+  }
+  if (options.has("approx")) {
+    engine->set_approximate(options.get_double("approx", 1e-4),
+			    (int) options.get_double("threads", 0));
+  }
+  if (options.has("link-stats")) {
+    engine->set_link_stats(options.get("link-stats"),
+			   options.get_double("link-stats-every", 0));
+  }
+  if (options.has("bottlenecks")) engine->set_bottleneck_stats(options.get("bottlenecks"));
+  if (options.has("fct-stats")) set_fct_stats(options.get("fct-stats"));
+  set_write_fcts(not options.has("no-fcts"));
+}
+
+void TraceSimulator::finish() {
+  engine->finish_link_stats();
+  engine->finish_bottleneck_stats();
+  if (const BottleneckStats* b = engine->get_bottleneck_stats()) b->write_summary(std::cout);
+  if (fct_stats) {
+    fct_stats->write_summary(std::cout);
+    if (not fct_stats_file.empty()) fct_stats->write_csv(fct_stats_file);
+  }
+}
+
+std::vector< std::string > simulator_options(const std::vector< std::string >& extra) {
+  std::vector< std::string > names = {"tree", "tree-check", "prune-links", "approx", "threads",
+				      "warm-start", "memo", "integer-time",
+				      "checkpoint", "checkpoint-every", "restore",
+				      "link-stats", "link-stats-every", "bottlenecks",
+				      "fct-stats", "no-fcts"};
+  names.insert(names.end(), extra.begin(), extra.end());
+  return names;
+}
@@ -0,0 +1,182 @@
+#ifndef TRACE_SIMULATOR_H
+#define TRACE_SIMULATOR_H
+
+#include "waterfilling_engine.h"
+#include "fct_stats.h"
+#include "options.h"
+#include <memory>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+
+// What wsim (ideal_simulator.cc) and wsim-ct (ideal_ct.cc) share: the
+// trace and fct files, the topology and engine, fct lines and stats,
+// checkpoints, the end of run report and the command line. Each
+// simulator reads its own trace format and runs its own event loop, and
+// adds its read ahead (and anything else it keeps between events) to
+// checkpoints through save_state() and restore_state().
+class TraceSimulator {
+ protected:
+  std::string flow_filename;
+  std::string out_filename;
+  std::string link_filename;
+
+  double min_bytes_for_priority_;
+  double priority_weight_;
+  double max_sim_time_;
+
+  PathTable& paths = PathTable::global();
+  // scratch kept across events so reading a line
+  // doesn't allocate once it's big enough
+  std::string line;
+  std::vector< link_t > path_buf;
+
+  std::unique_ptr<Topology> topology;
+  // active flows, rates, time and the next finish,
+  // a flow's state is freed once its fct is written
+  std::unique_ptr<WaterfillingEngine> engine;
+
+  std::ifstream flow_file;
+  std::ofstream out_file;
+
+  // engine->drain_until(), exits on a drain back in time or past a
+  // flow's finish
+  void drain_until(double time);
+  double flow_weight(double num_bytes) const {
+    return num_bytes < min_bytes_for_priority_ ? priority_weight_ : 1;
+  }
+
+  void write_fct(const FinishedFlow& flow);
+  // called for every finished flow before its fct line is written
+  virtual void flow_finished(const FinishedFlow&, double) {}
+  // fields the simulator adds to the end of the flow's fct line
+  virtual void write_fct_fields(const FinishedFlow&) {}
+  bool write_fcts = true; // a line per flow to out_file
+  // slowdown and fct summaries kept as flows finish (fct_stats.h),
+  // written to fct_stats_file at the end if it's set
+  std::unique_ptr<FctStats> fct_stats;
+  std::string fct_stats_file;
+  // end of run stats, after num_events events (or quanta)
+  void report(int num_events);
+  // what only this simulator reports, at the end of report()
+  virtual void simulator_report(int) {}
+
+  // checkpoints, written to checkpoint_file every checkpoint_every
+  // simulated seconds, on SIGUSR1 and when the run stops at
+  // max_sim_time (see checkpoint.h)
+  std::string checkpoint_file;
+  double checkpoint_every = 0;
+  double next_checkpoint = 0;
+  bool restored = false;
+  int restored_events = 0; // events (or quanta) before the checkpoint
+  void maybe_checkpoint(int num_events);
+  void save(const std::string& filename, int num_events);
+  // called from the simulator's constructor, restore_state() isn't
+  // there yet in ours
+  void restore(const std::string& filename);
+  // names the simulator a checkpoint is for
+  virtual const char* checkpoint_kind() const = 0;
+  // what the simulator keeps between events besides the engine, restore
+  // leaves checking in.good() to restore()
+  virtual void save_state(std::ostream& out) = 0;
+  virtual void restore_state(std::istream& in) = 0;
+  // added to every time read from the trace, see replay()
+  double trace_time_offset = 0;
+#ifdef WF_COUNT_ALLOCS
+  // heap allocations seen so far and what had grown by then (alloc_count.h)
+  long allocs_seen = 0;
+  size_t high_water_seen = 0;
+  int num_events_growing = 0;
+  // the second pass, where no event may allocate at all
+  bool replaying = false;
+  // sums sizes of every table and scratch buffer, only goes up
+  virtual size_t scratch_high_water();
+  // starts counting at the first event
+  void start_event_allocations();
+  // exits if the last event allocated without growing anything, or at
+  // all on the replay
+  void check_event_allocations();
+  // forgets the flows read ahead, the trace is read again from the top
+  virtual void rewind_trace() = 0;
+#endif
+ public:
+  // a restored run keeps the fcts written before its checkpoint, out
+  // file is opened by restore() then
+  TraceSimulator(const std::string& flow_filename,
+		 const std::string& out_filename,
+		 const std::string& link_filename,
+		 double min_bytes_for_priority,
+		 double priority_weight,
+		 double max_sim_time,
+		 bool restoring);
+  virtual ~TraceSimulator();
+  virtual void run() = 0;
+  WaterfillingEngine& get_engine() { return *engine; }
+  // checkpoint to filename every `every` simulated seconds (0 for
+  // only on SIGUSR1 and at max_sim_time)
+  void set_checkpoints(const std::string& filename, double every);
+  // the run picks up from a checkpoint
+  bool is_restored() const { return restored; }
+  // summarise fcts as flows finish, printed at the end and written as
+  // CSV to filename unless it's empty
+  void set_fct_stats(const std::string& filename);
+  // false leaves out the per flow fct lines
+  void set_write_fcts(bool on) { write_fcts = on; }
+  // sets up the engine and stats from the flags (see simulator_main)
+  virtual void apply_options(const Options& options);
+  // writes out link and bottleneck stats and the fct summary
+  void finish();
+#ifdef WF_COUNT_ALLOCS
+  // runs the trace again, shifted to start after the run ended. every
+  // table and scratch buffer is at its peak by then, so no event may
+  // touch the heap. fcts, stats and checkpoints are left as they were
+  void replay();
+#endif
+};
+
+// the flags every simulator takes:
+// --tree solves with the two-tier tree solver if the topology is one,
+// --tree=force whenever all paths are short enough, --tree-check
+// checks it against the general solver on every solve.
+// --prune-links drops links that can't be bottlenecks from each solve.
+// --approx[=epsilon] solves approximately on --threads=n threads.
+// --warm-start starts each solve from the last one's levels.
+// --memo[=MB] reuses the rates of flow class sets seen before.
+// --integer-time keeps time in picoseconds and bytes in integers.
+// --checkpoint=file writes checkpoints there every
+// --checkpoint-every=seconds (simulated), on SIGUSR1 and at
+// max_sim_time, --restore=file resumes from one.
+// --link-stats=file.csv writes per link mean load and flow count every
+// --link-stats-every=seconds and over the whole run.
+// --bottlenecks=file.csv writes how long each link limited flows, and
+// adds the link each flow was limited by longest to its fct line.
+// --fct-stats[=file.csv] prints slowdown and fct quantiles by flow
+// size (and writes them there), --no-fcts leaves out the fct lines
+std::vector< std::string > simulator_options(const std::vector< std::string >& extra);
+
+// flow, out and link file, min bytes for priority, priority weight,
+// max_sim_time, then the flags above and the simulator's extra ones
+template <class Simulator>
+int simulator_main(int argc, char** argv, const std::vector< std::string >& extra_options) {
+  if (argc < 7) {
+    std::cerr << "Expected 6 arguments to binary- flow, out and link file, min bytes for priority, priority weight, max_sim_time, [options]\n";
+    exit(1);
+  }
+  std::cout << "Got " << argv[1] << ", " << argv[2] << ", " << argv[3]
+	    << atof(argv[4]) << ", " << atof(argv[5]) << ", " << atof(argv[6])
+	    << std::endl;
+  Options options(argc, argv, 7, simulator_options(extra_options));
+  Simulator sim(argv[1], argv[2], argv[3], atof(argv[4]), atof(argv[5]), atof(argv[6]),
+		options.get("restore"));
+  sim.apply_options(options);
+  sim.run();
+  sim.finish();
+#ifdef WF_COUNT_ALLOCS
+  sim.replay();
+#endif
+  return 0;
+}
+
+#endif
@@ -0,0 +1,51 @@
+#include "tree_waterfilling.h"
+
+bool is_two_tier_tree(const Topology& topology) {
+  enum Tier { unknown, host, tor, agg };
+  int num_nodes = topology.num_nodes();
+  std::vector< int > tier(num_nodes, unknown);
+
+  // hosts have one link out and one back in, to the same node, their ToR
+  bool any_host = false;
+  for (int node = 0; node < num_nodes; node++) {
+    if (topology.out_end(node) - topology.out_begin(node) != 1) continue;
+    if (topology.in_end(node) - topology.in_begin(node) != 1) continue;
+    int up = topology.link_dst(*topology.out_begin(node));
+    if (topology.link_src(*topology.in_begin(node)) != up) continue;
+    tier[node] = host;
+    any_host = true;
+  }
+  if (not any_host) return false;
+  for (int node = 0; node < num_nodes; node++) {
+    if (tier[node] != host) continue;
+    int up = topology.link_dst(*topology.out_begin(node));
+    if (tier[up] == host) return false; // two hosts wired to each other
+    tier[up] = tor;
+  }
+  // whatever ToRs link to besides hosts is an agg
+  for (int node = 0; node < num_nodes; node++) {
+    if (tier[node] != tor) continue;
+    for (const int32_t* l = topology.out_begin(node); l != topology.out_end(node); l++) {
+      int dst = topology.link_dst(*l);
+      if (tier[dst] == unknown) tier[dst] = agg;
+    }
+  }
+
+  // every link has to be host<->ToR or ToR<->agg, and the links come in
+  // pairs so up and down paths match
+  for (int l = 0; l < topology.num_links(); l++) {
+    int src = tier[topology.link_src(l)];
+    int dst = tier[topology.link_dst(l)];
+    bool host_tor = (src == host and dst == tor) or (src == tor and dst == host);
+    bool tor_agg = (src == tor and dst == agg) or (src == agg and dst == tor);
+    if (not host_tor and not tor_agg) return false;
+    if (topology.link_id(topology.link_dst(l), topology.link_src(l)) < 0) return false;
+  }
+  // nodes with links that none of the above reached
+  for (int node = 0; node < num_nodes; node++) {
+    bool has_links = topology.out_end(node) != topology.out_begin(node)
+      or topology.in_end(node) != topology.in_begin(node);
+    if (has_links and tier[node] == unknown) return false;
+  }
+  return true;
+}
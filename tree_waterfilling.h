@@ -0,0 +1,219 @@
+#ifndef TREE_WATERFILLING_H
+#define TREE_WATERFILLING_H
+
+#include "waterfilling_solver.h"
+
+// true if the topology is a two-tier tree (leaf-spine, or a single
+// layer of ToRs): every node is a host with one link up to a ToR and one
+// back, a ToR linked only to hosts and aggs, or an agg linked only to
+// ToRs. Routed paths there are host->ToR->host or
+// host->ToR->agg->ToR->host, never more than 4 hops
+bool is_two_tier_tree(const Topology& topology);
+
+// Waterfilling for flows of at most max_hops links, the paths of a
+// two-tier tree. It doesn't use the tiers (a per tier closed form
+// doesn't fit weighted flows sharing agg uplinks), the tree only
+// bounds how many links a flow has. Instead of scanning every unsat
+// link each round, each link keeps the level its unsat pseudo flows
+// would fill it at, (capacity - rate of its saturated flows) / unsat
+// count, in a min heap.
+// The link on top saturates next, its unsat flows get that level, and
+// only the (at most max_hops) links of each of those flows need a new
+// level and one sift per round. A solve is O(F log L) for F flows on L
+// links instead of a scan of all unsat links per round, which pays off
+// on fabrics with thousands of links; on a few hundred the scan is
+// just as quick. It's the same max-min allocation as
+// WaterfillingSolver, but sums in a different order so rates can
+// differ in the last bits; flows with longer paths have to go to
+// WaterfillingSolver (see fits()).
+template <class WeightPolicy>
+class TreeWaterfillingSolver : public WaterfillingBase {
+  typedef typename WeightPolicy::count_t count_t;
+ protected:
+  const Topology& topology;
+  const PathLinkIds& paths;
+  Arena& arena;
+
+  // by topology link, the heap holds links with unsat flows
+  double* level_of_link;
+  int* heap; // topology link ids
+  int* heap_pos; // where the link is in heap, -1 if it isn't
+  int heap_size;
+
+  bool before(int a, int b) const {
+    // ties go to the lower link id, like the scan in WaterfillingSolver
+    return level_of_link[a] < level_of_link[b]
+      or (level_of_link[a] == level_of_link[b] and a < b);
+  }
+  void place(int pos, int link) {
+    heap[pos] = link;
+    heap_pos[link] = pos;
+  }
+  void sift_up(int pos);
+  void sift_down(int pos);
+  void remove(int link);
+
+ public:
+  static const int max_hops = 4;
+  TreeWaterfillingSolver(const Topology& topology,
+			 const PathLinkIds& paths,
+			 Arena& arena)
+    : topology(topology), paths(paths), arena(arena) {}
+  // whether every flow's path is short enough for us
+  static bool fits(const int* flow_paths, int num_flows, const PathLinkIds& paths) {
+    for (int f = 0; f < num_flows; f++) {
+      if (flow_paths[f] >= 0 and paths.size(flow_paths[f]) > max_hops) return false;
+    }
+    return true;
+  }
+  // like WaterfillingSolver::do_waterfilling, all paths have to fit
+  void do_waterfilling(const int* flow_paths, int num_flows,
+		       const WeightPolicy& weights,
+		       double* rates);
+};
+
+template <class WeightPolicy>
+void TreeWaterfillingSolver<WeightPolicy>::sift_up(int pos) {
+  int link = heap[pos];
+  while (pos > 0) {
+    int parent = (pos - 1) / 2;
+    if (not before(link, heap[parent])) break;
+    place(pos, heap[parent]);
+    pos = parent;
+  }
+  place(pos, link);
+}
+
+template <class WeightPolicy>
+void TreeWaterfillingSolver<WeightPolicy>::sift_down(int pos) {
+  int link = heap[pos];
+  while (true) {
+    int child = 2 * pos + 1;
+    if (child >= heap_size) break;
+    if (child + 1 < heap_size and before(heap[child + 1], heap[child])) child++;
+    if (not before(heap[child], link)) break;
+    place(pos, heap[child]);
+    pos = child;
+  }
+  place(pos, link);
+}
+
+template <class WeightPolicy>
+void TreeWaterfillingSolver<WeightPolicy>::remove(int link) {
+  int pos = heap_pos[link];
+  heap_pos[link] = -1;
+  int last = heap[--heap_size];
+  if (last == link) return;
+  place(pos, last);
+  sift_up(pos);
+  sift_down(heap_pos[last]);
+}
+
+template <class WeightPolicy>
+void TreeWaterfillingSolver<WeightPolicy>::do_waterfilling(
+		const int* flow_paths, int num_flows,
+		const WeightPolicy& weights,
+		double* rates) {
+  int num_links = topology.num_links();
+  // each flow's links in a fixed max_hops slots, and the flows on each
+  // link in CSR form: link_flows[link_begin[l] .. link_begin[l+1]-1]
+  int* flow_num_hops = arena.alloc<int>(num_flows, 0);
+  int* flow_links = arena.alloc<int>((size_t) num_flows * max_hops);
+  int* link_begin = arena.alloc<int>(num_links + 1, 0);
+  for (int f = 0; f < num_flows; f++) {
+    int path = flow_paths[f];
+    if (path < 0) continue;
+    int* links = flow_links + (size_t) f * max_hops;
+    for (const int* id = paths.begin(path); id != paths.end(path); id++) {
+      links[flow_num_hops[f]++] = *id;
+      link_begin[*id + 1]++;
+    }
+  }
+  for (int l = 0; l < num_links; l++) link_begin[l + 1] += link_begin[l];
+  int* link_flows = arena.alloc<int>(link_begin[num_links]);
+  int* next = arena.alloc<int>(num_links);
+  std::copy(link_begin, link_begin + num_links, next);
+
+  count_t* num_unsat = arena.alloc<count_t>(num_links, 0);
+  int* unsat_flows = arena.alloc<int>(num_links, 0);
+  KahanSum* saturated_flow = arena.alloc<KahanSum>(num_links, KahanSum());
+  bool* flow_unsat = arena.alloc<bool>(num_flows, false);
+  for (int f = 0; f < num_flows; f++) {
+    if (flow_paths[f] < 0) continue;
+    flow_unsat[f] = true;
+    const int* links = flow_links + (size_t) f * max_hops;
+    for (int h = 0; h < flow_num_hops[f]; h++) {
+      link_flows[next[links[h]]++] = f;
+      num_unsat[links[h]] += weights.count(f);
+      unsat_flows[links[h]]++;
+    }
+  }
+
+  level_of_link = arena.alloc<double>(num_links, 0);
+  heap = arena.alloc<int>(num_links);
+  heap_pos = arena.alloc<int>(num_links, -1);
+  heap_size = 0;
+  for (int l = 0; l < num_links; l++) {
+    if (unsat_flows[l] == 0) continue;
+    level_of_link[l] = topology.capacity(l) / num_unsat[l];
+    place(heap_size++, l);
+  }
+  for (int pos = heap_size / 2 - 1; pos >= 0; pos--) sift_down(pos);
+
+  // links whose level changed this round, each is sifted once
+  int* touched = arena.alloc<int>(num_links);
+  bool* is_touched = arena.alloc<bool>(num_links, false);
+  double level = 0;
+  while (heap_size > 0) {
+    int min_link = heap[0];
+    // rounding can put a link a hair below the level already reached
+    level = std::max(level, level_of_link[min_link]);
+    remove(min_link);
+
+    count_t expected = num_unsat[min_link];
+    count_t saturated = 0;
+    int num_touched = 0;
+    for (int i = link_begin[min_link]; i < link_begin[min_link + 1]; i++) {
+      int f = link_flows[i];
+      if (not flow_unsat[f]) continue;
+      flow_unsat[f] = false;
+      count_t count = weights.count(f);
+      saturated += count;
+      rates[f] = weights.weight(f) * level;
+      const int* links = flow_links + (size_t) f * max_hops;
+      for (int h = 0; h < flow_num_hops[f]; h++) {
+	int link = links[h];
+	saturated_flow[link].add(level * count);
+	// exactly 0 once the last one is gone, double counts may not cancel
+	if (--unsat_flows[link] == 0) num_unsat[link] = 0;
+	else num_unsat[link] -= count;
+	if (heap_pos[link] >= 0 and not is_touched[link]) {
+	  is_touched[link] = true;
+	  touched[num_touched++] = link;
+	}
+      }
+    }
+    for (int t = 0; t < num_touched; t++) {
+      int link = touched[t];
+      is_touched[link] = false;
+      if (unsat_flows[link] == 0) {
+	remove(link);
+	continue;
+      }
+      // fewer unsat flows sharing what's left, the level only goes up
+      level_of_link[link] = (topology.capacity(link) - saturated_flow[link].sum) / num_unsat[link];
+      sift_down(heap_pos[link]);
+      sift_up(heap_pos[link]);
+    }
+
+    if (counts_differ(saturated, expected)) {
+      std::cerr << "min level link " << get_str(topology.get_link(min_link))
+		<< " num_unsat " << expected
+		<< " not equal to " << saturated
+		<< " (book-keeping error?)\n";
+      exit(1);
+    }
+  }
+}
+
+#endif
@@ -1,44 +1,22 @@
-#include <map>
-#include <vector>
-#include <set>
-#include <utility> // std::pair
-typedef std::pair<int, int> link_t;
+#ifndef WATERFILLING_H
+#define WATERFILLING_H
 
-//typedef int link_t;
+#include "waterfilling_solver.h"
+#include <memory>
 
-class Waterfilling;
-
-// we only care about which links are used, order doesn't matter
-class WaterfillingState {
-  friend Waterfilling;
+// unweighted max-min, every flow counts once
+class Waterfilling : public WaterfillingBase {
  protected:
-  void show();
-  int round;
-  std::set< link_t > unsaturated_links; 
-  std::set< int > unsaturated_flows;
-  std::map< link_t, int > num_unsat_per_link;
-  std::map< link_t, double > total_flow_per_link;
-  std::map< link_t, std::vector< int > > active_flows_per_link;
-  std::map< int, double > rate_per_flow;
-  
-  std::map< int, int > flow_saturated_in_round;
-  std::map< link_t, int > link_saturated_in_round;
+  std::unique_ptr<Topology> topology;
+  PathTable& paths;
+  Arena arena;
+  PathLinkIds path_links;
 
-  std::vector<double> rate_increments;
  public:
-WaterfillingState(const std::map<int, std::vector< link_t > > & flow_to_path);
-};
-
-class Waterfilling {
- protected:
-  std::map< link_t, double> link_capacities;
-  std::map<int, std::vector< link_t > > flow_to_path;
-
- public:
-  Waterfilling(const std::map< link_t, double>& link_capacities);
-  static std::string get_str(const link_t & link);
-  static double get_sum(const std::vector<double> & summands);
-  void do_one_round_of_waterfilling(WaterfillingState& wfs);
+  Waterfilling(const std::map< link_t, double>& link_capacities,
+	       PathTable& paths = PathTable::global());
   void do_waterfilling(const std::map<int, std::vector< link_t > >& flow_to_path, 
                             std::map<int, double >& rates);
 };
+
+#endif
@@ -0,0 +1,396 @@
+#include "waterfilling_engine.h"
+#include "checkpoint.h"
+#include <iostream>
+#include <algorithm>
+#include <cstdlib>
+#include <cmath>
+
+// picobits in a byte
+static const __int128 picobits_per_byte = (__int128) 8 * 1000000000000ll;
+
+static int64_t to_ps(double time) { return std::llround(time * 1e12); }
+
+WaterfillingEngine::WaterfillingEngine(const Topology& topology,
+				       PathTable& paths)
+  : topology(topology), paths(paths),
+    wf(topology, paths), routes(topology, paths) {}
+
+int WaterfillingEngine::add_flow(int flow_id, int path, double bytes, double weight,
+				 double arrived) {
+  if (path < 0 or path >= paths.num_paths()) {
+    std::cerr << "can't add flow " << flow_id << " with path " << path << "\n";
+    exit(1);
+  }
+  int slot = flows.add(flow_id);
+  flows.start[slot] = arrived >= 0 ? arrived : now;
+  flows.size[slot] = bytes;
+  flows.path[slot] = path;
+  flows.bytes_left[slot] = bytes;
+  flows.weight[slot] = weight;
+  if (coalescing) {
+    if ((int) ran_out_at.size() < flows.num_slots()) ran_out_at.resize(flows.num_slots());
+    ran_out_at[slot] = -1;
+  }
+  if (integer_time) {
+    if ((int) picobits_left.size() < flows.num_slots()) {
+      picobits_left.resize(flows.num_slots());
+      bits_per_sec.resize(flows.num_slots());
+    }
+    picobits_left[slot] = std::llround(bytes) * picobits_per_byte;
+    bits_per_sec[slot] = 0;
+  }
+  peak_active_flows = std::max(peak_active_flows, (size_t) flows.num_active());
+  if (link_stats) link_stats->add_flow(path, now);
+  if (bottleneck_stats) bottleneck_stats->add_flow(slot, path, now);
+  rates_stale = true;
+  return slot;
+}
+
+bool WaterfillingEngine::end_flow(int flow_id) {
+  int slot = flows.find(flow_id);
+  if (slot < 0) return false;
+  flows.bytes_left[slot] = 0;
+  if (integer_time) picobits_left[slot] = 0;
+  rates_stale = true;
+  return true;
+}
+
+bool WaterfillingEngine::remove_flow(int flow_id) {
+  int slot = flows.find(flow_id);
+  if (slot < 0) return false;
+  if (link_stats) link_stats->remove_flow(flows.path[slot], flows.rate[slot], now);
+  if (bottleneck_stats) bottleneck_stats->remove_flow(slot, now);
+  flows.remove(slot);
+  rates_stale = true;
+  return true;
+}
+
+double WaterfillingEngine::get_rate(int flow_id) const {
+  int slot = flows.find(flow_id);
+  if (slot < 0) return -1;
+  return flows.rate[slot];
+}
+
+DrainStatus WaterfillingEngine::drain_until(double time) {
+  if (integer_time) return drain_integer(time);
+  double dur = time - now;
+  if (dur <= 0) {
+    if (dur < -1e-6) return DrainStatus::time_went_back;
+    now = time;
+    return DrainStatus::ok;
+  }
+  if (link_stats) link_stats->advance(time);
+
+  DrainStatus status = DrainStatus::ok;
+  for (int slot = 0; slot < flows.num_slots(); slot++) {
+    if (not flows.in_use(slot)) continue;
+    double bytes = flows.bytes_left[slot];
+    // rate is in gb/s, size is in bytes
+    double rate = flows.rate[slot];
+    // ended and finished flows wait for retire_finished(), flows added
+    // since the last solve have no rate yet
+    if (bytes <= 0 or rate <= 0) continue;
+    if (coalescing and ran_out_at[slot] >= 0) continue;
+    if (coalescing and (rate * 1e9 * dur) / 8 >= bytes) {
+      ran_out_at[slot] = now + (bytes * 8) / (rate * 1e9);
+      flows.bytes_left[slot] = 0;
+      continue;
+    }
+    double bytes_drained = (rate * 1e9 * dur)/8;
+    double new_bytes = bytes - bytes_drained;
+    if (new_bytes < -1) {
+      status = DrainStatus::past_finish;
+      drain_error_flow = flows.flow_id[slot];
+    }
+    flows.bytes_left[slot] = std::max(new_bytes, 0.0);
+  }
+  now = time;
+  return status;
+}
+
+DrainStatus WaterfillingEngine::drain_integer(double time) {
+  // the finish we handed out goes back to its own picosecond
+  int64_t time_ps = time == next_finish ? next_finish_ps : to_ps(time);
+  int64_t dur = time_ps - now_ps;
+  if (dur <= 0) {
+    if (dur < -1000000) return DrainStatus::time_went_back;
+    now = time;
+    return DrainStatus::ok;
+  }
+  if (link_stats) link_stats->advance(time);
+
+  DrainStatus status = DrainStatus::ok;
+  for (int slot = 0; slot < flows.num_slots(); slot++) {
+    if (not flows.in_use(slot)) continue;
+    __int128 left = picobits_left[slot] - (__int128) bits_per_sec[slot] * dur;
+    if (coalescing and left <= 0) {
+      if (ran_out_at[slot] < 0) {
+	// ended flows have nothing left and may not have a rate yet
+	int64_t rate = bits_per_sec[slot];
+	int64_t dur = rate > 0 ? (int64_t) ((picobits_left[slot] + rate - 1) / rate) : 0;
+	ran_out_at[slot] = (now_ps + dur) / 1e12;
+      }
+      left = 0;
+    }
+    if (left < 0) {
+      // a finish is rounded up to the next picosecond, anything more
+      // than that means a finish was skipped
+      if (left <= -(__int128) bits_per_sec[slot]) {
+	status = DrainStatus::past_finish;
+	drain_error_flow = flows.flow_id[slot];
+      }
+      left = 0;
+    }
+    picobits_left[slot] = left;
+    flows.bytes_left[slot] = (double) left / picobits_per_byte;
+  }
+  now = time;
+  now_ps = time_ps;
+  return status;
+}
+
+void WaterfillingEngine::set_integer_time(bool on) {
+  if (on == integer_time) return;
+  if (flows.num_active() > 0) {
+    std::cerr << "can't switch integer time with " << flows.num_active()
+	      << " active flows\n";
+    exit(1);
+  }
+  integer_time = on;
+  now_ps = to_ps(now);
+  next_finish_ps = -1;
+}
+
+int WaterfillingEngine::retire_finished() {
+  // (flow id, slot), reported in flow id order
+  flows_to_remove.clear();
+  for (int slot = 0; slot < flows.num_slots(); slot++) {
+    if (not flows.in_use(slot)) continue;
+    if (integer_time ? picobits_left[slot] <= 0 : flows.bytes_left[slot] < 1e-3) {
+      flows_to_remove.push_back(std::make_pair(flows.flow_id[slot], slot));
+    }
+  }
+  std::sort(flows_to_remove.begin(), flows_to_remove.end());
+
+  for (auto fs : flows_to_remove) {
+    int slot = fs.second;
+    int bottleneck = bottleneck_stats ? bottleneck_stats->remove_flow(slot, now) : -1;
+    if (on_finish) {
+      FinishedFlow flow;
+      flow.flow_id = fs.first;
+      flow.path = flows.path[slot];
+      flow.start = flows.start[slot];
+      flow.end = now;
+      if (coalescing and ran_out_at[slot] >= 0) flow.end = ran_out_at[slot];
+      flow.released = now;
+      flow.size = flows.size[slot];
+      flow.bottleneck = bottleneck;
+      on_finish(flow);
+    }
+    if (link_stats) link_stats->remove_flow(flows.path[slot], flows.rate[slot], now);
+    flows.remove(slot);
+  }
+  if (flows_to_remove.size() > 0) rates_stale = true;
+  return flows_to_remove.size();
+}
+
+void WaterfillingEngine::update_rates() {
+  if (flows.num_active() > 0) {
+    bool track_changes = on_rate_change or link_stats;
+    if (track_changes) old_rates.assign(flows.rate.begin(), flows.rate.end());
+    if (approx) {
+      approx->do_waterfilling(flows.path.data(), flows.weight.data(),
+			      flows.num_slots(), flows.rate.data());
+    } else {
+      wf.do_waterfilling(flows.path.data(), flows.weight.data(),
+			 flows.num_slots(), flows.rate.data());
+    }
+    if (track_changes) {
+      for (int slot = 0; slot < flows.num_slots(); slot++) {
+	if (flows.in_use(slot) and flows.rate[slot] != old_rates[slot]) {
+	  if (link_stats) {
+	    link_stats->change_rate(flows.path[slot], flows.rate[slot] - old_rates[slot], now);
+	  }
+	  if (on_rate_change) on_rate_change(flows.flow_id[slot], now, flows.rate[slot]);
+	}
+      }
+    }
+  }
+  if (bottleneck_stats) bottleneck_stats->update(flows, now);
+  rates_stale = false;
+  num_solves++;
+  if (snapshots) snapshots->publish(flows, now);
+  if (integer_time) find_next_finish_integer();
+  else find_next_finish();
+}
+
+void WaterfillingEngine::set_approximate(double epsilon, int num_threads) {
+  if (epsilon <= 0) {
+    approx.reset();
+    return;
+  }
+  if (not approx or (num_threads > 0 and approx->get_num_threads() != num_threads)) {
+    approx.reset(new ApproxWaterfilling(topology, paths, num_threads));
+  }
+  approx->set_epsilon(epsilon);
+  rates_stale = true;
+}
+
+void WaterfillingEngine::find_next_finish() {
+  // reset old finish times
+  next_finish = -1;
+  next_flow_to_finish = -1;
+
+  // and get new finish times
+  double min_finish_dur = -1;
+  int min_finish_flow = -1;
+  for (int slot = 0; slot < flows.num_slots(); slot++) {
+    if (not flows.in_use(slot)) continue;
+    double bytes = flows.bytes_left[slot];
+    // rate is in gb/s, size is in bytes
+    double rate = flows.rate[slot];
+    // flows the solver left without a rate don't finish at these rates
+    if (rate <= 0) continue;
+    double dur = (bytes * 8) / (rate * 1e9);
+    if (min_finish_dur == -1 or dur < min_finish_dur) {
+      min_finish_dur = dur;
+      min_finish_flow = flows.flow_id[slot];
+    }
+  }
+
+  if (min_finish_dur > 0) {
+    next_finish = now + min_finish_dur;
+    next_flow_to_finish = min_finish_flow;
+  }
+}
+
+void WaterfillingEngine::find_next_finish_integer() {
+  next_finish = -1;
+  next_finish_ps = -1;
+  next_flow_to_finish = -1;
+  for (int slot = 0; slot < flows.num_slots(); slot++) {
+    if (not flows.in_use(slot)) continue;
+    // rounded down, so a flow never gets more than it was given
+    int64_t rate = (int64_t) (flows.rate[slot] * 1e9);
+    // a flow the solver left without a rate still finishes, eventually
+    if (rate <= 0) rate = 1;
+    bits_per_sec[slot] = rate;
+    // rounded up, the first picosecond with nothing left
+    int64_t dur = (int64_t) ((picobits_left[slot] + rate - 1) / rate);
+    if (next_finish_ps < 0 or now_ps + dur < next_finish_ps) {
+      next_finish_ps = now_ps + dur;
+      next_flow_to_finish = flows.flow_id[slot];
+    }
+  }
+  if (next_finish_ps >= 0) next_finish = next_finish_ps / 1e12;
+}
+
+DrainStatus WaterfillingEngine::advance(double time) {
+  if (rates_stale) {
+    retire_finished();
+    update_rates();
+  }
+  while (next_finish > 0 and next_finish <= time) {
+    DrainStatus status = drain_until(next_finish);
+    if (status != DrainStatus::ok) return status;
+    retire_finished();
+    update_rates();
+  }
+  if (time > now) return drain_until(time);
+  return DrainStatus::ok;
+}
+
+void WaterfillingEngine::set_link_stats(const std::string& filename, double interval) {
+  link_stats.reset(new LinkStats(topology, paths, filename, interval));
+  for (int slot = 0; slot < flows.num_slots(); slot++) {
+    if (not flows.in_use(slot)) continue;
+    link_stats->add_flow(flows.path[slot], now);
+    link_stats->change_rate(flows.path[slot], flows.rate[slot], now);
+  }
+}
+
+void WaterfillingEngine::finish_link_stats() {
+  if (link_stats) link_stats->write_report(now);
+}
+
+void WaterfillingEngine::set_bottleneck_stats(const std::string& filename) {
+  bottleneck_stats.reset(new BottleneckStats(topology, paths, filename));
+  for (int slot = 0; slot < flows.num_slots(); slot++) {
+    if (flows.in_use(slot)) bottleneck_stats->add_flow(slot, flows.path[slot], now);
+  }
+  if (not rates_stale and flows.num_active() > 0) bottleneck_stats->update(flows, now);
+}
+
+void WaterfillingEngine::finish_bottleneck_stats() {
+  if (bottleneck_stats) bottleneck_stats->write_report(now);
+}
+
+WhatIf& WaterfillingEngine::what_if() {
+  if (rates_stale) {
+    std::cerr << "what-if at time " << now
+	      << " with flows added or removed since the last solve\n";
+    exit(1);
+  }
+  if (not what_if_) what_if_.reset(new WhatIf(topology, paths));
+  if (what_if_solve != num_solves) {
+    what_if_->load(flows);
+    what_if_solve = num_solves;
+  }
+  return *what_if_;
+}
+
+void WaterfillingEngine::save(std::ostream& out) const {
+  checkpoint_put(out, now);
+  checkpoint_put(out, next_finish);
+  checkpoint_put(out, next_flow_to_finish);
+  checkpoint_put(out, rates_stale);
+  checkpoint_put(out, peak_active_flows);
+  checkpoint_put(out, num_solves);
+  checkpoint_put(out, integer_time);
+  checkpoint_put(out, now_ps);
+  checkpoint_put(out, next_finish_ps);
+  checkpoint_put(out, picobits_left);
+  checkpoint_put(out, bits_per_sec);
+  checkpoint_put(out, coalescing);
+  checkpoint_put(out, ran_out_at);
+  flows.save(out);
+}
+
+void WaterfillingEngine::restore(std::istream& in) {
+  checkpoint_get(in, now);
+  checkpoint_get(in, next_finish);
+  checkpoint_get(in, next_flow_to_finish);
+  checkpoint_get(in, rates_stale);
+  checkpoint_get(in, peak_active_flows);
+  checkpoint_get(in, num_solves);
+  checkpoint_get(in, integer_time);
+  checkpoint_get(in, now_ps);
+  checkpoint_get(in, next_finish_ps);
+  checkpoint_get(in, picobits_left);
+  checkpoint_get(in, bits_per_sec);
+  checkpoint_get(in, coalescing);
+  checkpoint_get(in, ran_out_at);
+  flows.restore(in);
+  what_if_solve = -1;
+}
+
+size_t WaterfillingEngine::scratch_bytes() const {
+  return wf.scratch_bytes() + (approx ? approx->memory_bytes() : 0)
+    + flows_to_remove.capacity() * sizeof(flows_to_remove[0])
+    + old_rates.capacity() * sizeof(rate_t)
+    + picobits_left.capacity() * sizeof(__int128)
+    + bits_per_sec.capacity() * sizeof(int64_t)
+    + ran_out_at.capacity() * sizeof(double);
+}
+
+size_t WaterfillingEngine::scratch_high_water() const {
+  // every memo miss stores a new allocation
+  long memo_inserts = wf.get_memo() ? wf.get_memo()->get_num_misses() : 0;
+  return wf.get_arena_mallocs() + wf.get_path_links_capacity() + wf.get_warm_capacity()
+    + memo_inserts
+    + (approx ? approx->capacity_held() : 0)
+    + flows.num_slots()
+    + paths.num_paths() + paths.storage_capacity()
+    + flows_to_remove.capacity() + old_rates.capacity()
+    + picobits_left.capacity() + bits_per_sec.capacity() + ran_out_at.capacity();
+}
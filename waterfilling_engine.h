@@ -0,0 +1,219 @@
+#ifndef WATERFILLING_ENGINE_H
+#define WATERFILLING_ENGINE_H
+
+#include "weighted_waterfilling.h"
+#include "routing.h"
+#include "flow_table.h"
+#include "rate_snapshot.h"
+#include "what_if.h"
+#include "approx_waterfilling.h"
+#include "link_stats.h"
+#include "bottleneck_stats.h"
+#include <memory>
+#include <functional>
+#include <vector>
+#include <cstdint>
+
+// what drain_until() found. Times up to a microsecond back and flows up
+// to a byte (or a picosecond) past their finish are rounding, they're
+// clamped without a word. Anything more is an error: a drain back in
+// time leaves the clock where it was, a flow drained past its finish
+// means a finish was skipped, it's stopped at 0 and the drain goes on
+enum class DrainStatus { ok, time_went_back, past_finish };
+
+// a flow whose bytes have all been sent (or that was ended)
+struct FinishedFlow {
+  int flow_id;
+  int path;
+  double start;
+  double end;
+  double size; // bytes when the flow started
+  // when its bandwidth went back to the others, after end if coalescing
+  double released;
+  // topology link id it was bottlenecked on longest, -1 if that isn't
+  // tracked (see set_bottleneck_stats)
+  int bottleneck;
+};
+
+// The flow-level event core the simulators and the C API (wf_api.h)
+// share: active flows in a FlowTable, max-min rates from
+// WeightedWaterfilling, bytes drained as time moves on. Nothing is solved
+// behind the caller's back, update_rates() solves and finds the next
+// finish, so several adds or ends at one time can share one solve.
+// Rates are in Gb/s, sizes in bytes, times in seconds.
+//
+// With set_integer_time() the clock and the bytes left are kept in
+// integers: time in picoseconds, what's left of a flow in picobits
+// (bits * 1e12, 128 bit) and rates rounded down to whole bits per
+// second, so a flow drains exactly rate * dt picobits in dt ps. A flow
+// finishes at the first picosecond it has nothing left, and flows due
+// at the same picosecond all finish in that one event instead of a few
+// events nanoseconds apart. Rates are off by under a bit per second and
+// runs come out the same on every machine. Times still come in and go
+// out as seconds, up to about 2000 s they round trip exactly.
+class WaterfillingEngine {
+ protected:
+  const Topology& topology;
+  PathTable& paths;
+  WeightedWaterfilling wf;
+  RouteTable routes;
+  FlowTable flows;
+
+  double now = -1;
+  double next_finish = -1;
+  int next_flow_to_finish = -1;
+  bool rates_stale = false;
+  size_t peak_active_flows = 0;
+  int drain_error_flow = -1; // the last flow drained past its finish
+  RateSnapshots* snapshots = nullptr; // not ours
+  long num_solves = 0;
+  std::unique_ptr<ApproxWaterfilling> approx; // solves instead of wf if set
+  std::unique_ptr<WhatIf> what_if_;
+  long what_if_solve = -1; // solve what_if_ has loaded
+
+  // integer time, by slot if per flow (see above)
+  bool integer_time = false;
+  int64_t now_ps = 0;
+  int64_t next_finish_ps = -1;
+  std::vector< __int128 > picobits_left;
+  std::vector< int64_t > bits_per_sec;
+
+  // coalescing: drains may run past finishes, flows stop at 0 and
+  // remember when they got there (by slot, -1 if they haven't)
+  bool coalescing = false;
+  std::vector< double > ran_out_at;
+
+  std::unique_ptr<LinkStats> link_stats;
+  std::unique_ptr<BottleneckStats> bottleneck_stats;
+
+  // scratch kept across events
+  std::vector< std::pair<int, int> > flows_to_remove; // (flow id, slot)
+  std::vector< rate_t > old_rates;
+
+  void find_next_finish();
+  DrainStatus drain_integer(double time);
+  void find_next_finish_integer();
+
+ public:
+  // called for every flow retire_finished() takes out, in flow id order
+  std::function< void(const FinishedFlow&) > on_finish;
+  // called by update_rates() for every flow whose rate changed
+  std::function< void(int flow_id, double time, double rate) > on_rate_change;
+
+  // topology and paths have to outlive us
+  WaterfillingEngine(const Topology& topology,
+		     PathTable& paths = PathTable::global());
+
+  // path id of a flow from src to dst, picked by flow id among the
+  // equal cost paths, -1 if dst can't be reached
+  int route(int src, int dst, int flow_id) { return routes.route(src, dst, flow_id); }
+  // all the equal cost paths, empty if dst can't be reached
+  const std::vector< int >& get_routes(int src, int dst) { return routes.get_routes(src, dst); }
+
+  // adds a flow at the current time, returns its flow table slot.
+  // its rate is 0 until the next update_rates(). arrived is its start
+  // if it's added late (see set_coalescing), the current time if < 0
+  int add_flow(int flow_id, int path, double bytes, double weight, double arrived = -1);
+  // flow is done, it's taken out (and reported) by the next
+  // retire_finished(). false if it isn't active
+  bool end_flow(int flow_id);
+  // drops the flow right away without reporting it
+  bool remove_flow(int flow_id);
+
+  // moves the clock to time, draining bytes at the current rates
+  DrainStatus drain_until(double time);
+  // the flow id behind the last past_finish
+  int get_drain_error_flow() const { return drain_error_flow; }
+  // takes out flows with (almost) no bytes left, returns how many
+  int retire_finished();
+  // solves for the active flows and finds the next finish
+  void update_rates();
+  // for callers without their own event loop: solves if needed, then
+  // drains and retires flows finishing up to time, re-solving each time.
+  // stops at the first drain that isn't ok
+  DrainStatus advance(double time);
+
+  double get_time() const { return now; }
+  // -1 when no active flow will finish
+  double get_next_finish() const { return next_finish; }
+  int get_next_flow_to_finish() const { return next_flow_to_finish; }
+  // Gb/s as of the last update_rates(), -1 if flow isn't active
+  double get_rate(int flow_id) const;
+  bool rates_need_update() const { return rates_stale; }
+
+  // read-only queries against the last solve, e.g. the rate a new flow
+  // would get on each of its candidate paths (what_if.h). rates must be
+  // up to date, the flow table can't change while it's in use
+  WhatIf& what_if();
+  // update_rates() calls so far
+  long get_num_solves() const { return num_solves; }
+
+  const FlowTable& get_flows() const { return flows; }
+  const WeightedWaterfilling& get_solver() const { return wf; }
+  // faster solves for many flows, rates may change in the last bits
+  void set_incremental_solve(bool on) { wf.set_incremental(on); }
+  // O(F log F) solves on leaf-spine fabrics, falls back to the general
+  // solver elsewhere (weighted_waterfilling.h)
+  void set_solver_mode(SolverMode mode) { wf.set_solver_mode(mode); }
+  // exit if the tree solver ever disagrees with the general one
+  void set_tree_check(bool on) { wf.set_tree_check(on); }
+  // skip links that can't be a bottleneck of the active flows, same rates
+  void set_link_pruning(bool on) { wf.set_link_pruning(on); }
+  // start each solve from the last one's levels, rates can change in
+  // the last bits (weighted_waterfilling.h)
+  void set_warm_start(bool on) { wf.set_warm_start(on); }
+  // hand back the rates of flow class sets seen before, keeping at most
+  // max_bytes of them (rate_memo.h), 0 turns it off
+  void set_memo(size_t max_bytes) { wf.set_memo(max_bytes); }
+  // solve by fixed-point iteration on num_threads (0 is one per core)
+  // until levels move by no more than epsilon, rates are close to
+  // max-min but not exact (approx_waterfilling.h). epsilon 0 goes back
+  // to exact solves
+  void set_approximate(double epsilon, int num_threads = 0);
+  // nullptr unless solving approximately
+  const ApproxWaterfilling* get_approx_solver() const { return approx.get(); }
+  // let drain_until() run past finishes: a flow that runs out on the
+  // way stops there and is reported by retire_finished() with the end it
+  // had, its bandwidth goes back to the others at the next solve. For
+  // callers that apply a batch of events at once (wsim --quantum)
+  void set_coalescing(bool on) {
+    coalescing = on;
+    ran_out_at.assign(flows.num_slots(), -1);
+  }
+  // keep time and bytes in integers (see above), only before any flow
+  // is added
+  void set_integer_time(bool on);
+  bool get_integer_time() const { return integer_time; }
+  // publish the rates to snapshots after every solve, for readers on
+  // other threads (rate_snapshot.h). nullptr to stop
+  void set_snapshots(RateSnapshots* s) { snapshots = s; }
+  size_t get_peak_active_flows() const { return peak_active_flows; }
+  // integrate every link's load and flow count as flows come, go and
+  // change rate, writing a CSV row per link used every interval seconds
+  // (link_stats.h). flows already active count from now on
+  void set_link_stats(const std::string& filename, double interval);
+  // the last interval and the per link totals, up to the current time
+  void finish_link_stats();
+  // find every flow's bottleneck link after each solve, finished flows
+  // report the one they spent longest on and each link's time as a
+  // bottleneck goes to filename at the end (bottleneck_stats.h)
+  void set_bottleneck_stats(const std::string& filename);
+  // writes that per link report, up to the current time
+  void finish_bottleneck_stats();
+  // nullptr unless set
+  const BottleneckStats* get_bottleneck_stats() const { return bottleneck_stats.get(); }
+  // the flows, clock and next finish, with the rates of the last solve
+  // (checkpoint.h). restore() replaces what's there and takes the
+  // integer time and coalescing settings of the saved engine; solver
+  // state (warm starts, memo) starts over
+  void save(std::ostream& out) const;
+  void restore(std::istream& in);
+  // sums the sizes of every table and scratch buffer, only goes up
+  // (see alloc_count.h)
+  size_t scratch_high_water() const;
+  // bytes held besides the flow table and the memo: the solvers'
+  // scratch and the engine's own per slot arrays
+  size_t scratch_bytes() const;
+};
+
+#endif
@@ -0,0 +1,713 @@
+#ifndef WATERFILLING_SOLVER_H
+#define WATERFILLING_SOLVER_H
+
+#include <map>
+#include <vector>
+#include <set>
+#include <string>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstdint>
+#include <limits>
+#include "path_table.h"
+#include "topology.h"
+#include "arena.h"
+
+// Weight policies say how many pseudo flows a flow stands for, a flow of
+// weight w acts like w flows and gets w times the rate of an unweighted one.
+// count(f) is what f adds to num_unsat, weight(f) scales the pseudo flow
+// rate into f's rate; they only differ for aggregated flows (see below).
+// count_t is what num_unsat is kept in. UnitWeights returns a constant so
+// the solver compiles down to plain counting with no weight lookups and
+// no multiplications. ClassWeights is for weights drawn from a few small
+// integers (1 and the priority weight), counting stays exact in int64_t:
+// a link's count is at most the number of flows times the largest
+// weight, even with a whole aggregated class on it.
+struct UnitWeights {
+  typedef int count_t;
+  count_t count(int) const { return 1; }
+  count_t weight(int) const { return 1; }
+};
+
+struct ClassWeights {
+  typedef int64_t count_t;
+  explicit ClassWeights(const double* flow_weights)
+    : flow_weights(flow_weights) {}
+  count_t count(int flow) const { return weight(flow); }
+  count_t weight(int flow) const { return (count_t) flow_weights[flow]; }
+  const double* flow_weights;
+};
+
+struct DoubleWeights {
+  typedef double count_t;
+  explicit DoubleWeights(const double* flow_weights)
+    : flow_weights(flow_weights) {}
+  count_t count(int flow) const { return weight(flow); }
+  count_t weight(int flow) const { return flow_weights[flow]; }
+  const double* flow_weights;
+};
+
+// Flows with the same path and weight get the same rate, so they can be
+// solved as one entity standing for multiplicity[e] of them. Entities
+// are numbered 0..n-1, count is multiplicity times the per-flow weight
+// and the rate handed back is still that of one member flow.
+template <class WeightPolicy>
+struct AggregatedWeights {
+  typedef typename WeightPolicy::count_t count_t;
+  AggregatedWeights(const WeightPolicy& per_flow,
+		    const int* multiplicity)
+    : per_flow(per_flow), multiplicity(multiplicity) {}
+  count_t count(int entity) const {
+    return multiplicity[entity] * per_flow.weight(entity);
+  }
+  count_t weight(int entity) const { return per_flow.weight(entity); }
+  const WeightPolicy& per_flow;
+  const int* multiplicity;
+};
+
+// num_unsat is summed in a different order when we double check it,
+// so doubles only have to agree up to rounding
+inline bool counts_differ(int a, int b) { return a != b; }
+inline bool counts_differ(int64_t a, int64_t b) { return a != b; }
+inline bool counts_differ(double a, double b) {
+  return std::abs(a - b) > 1e-9 * std::max(1.0, std::abs(a));
+}
+
+// kahan summation from wiki, one summand at a time
+struct KahanSum {
+  double sum = 0.0;
+  double c = 0.0; // running compensation for lost precision
+  void add(double s) {
+    double y = s - c;
+    double t = sum + y;
+    c = (t - sum) - y;
+    sum = t;
+  }
+};
+
+class WaterfillingBase {
+ public:
+  static std::string get_str(const link_t& link) {
+    std::stringstream ss;
+    ss << link.first << "->" << link.second;
+    return ss.str();
+  }
+
+  static double get_sum(const std::vector<double>& summands) {
+    // double sum = 0;
+    //for (const auto& s : summands) sum += s;
+    KahanSum sum;
+    for (const auto& s : summands) sum.add(s);
+    return sum.sum;
+  }
+};
+
+
+// topology link ids along every path in a path table, looked up once
+// when the path is first solved rather than on every hop of every solve.
+// Paths are never removed from the table, so this only grows
+class PathLinkIds {
+ protected:
+  std::vector< int > offsets = {0};
+  std::vector< int > ids;
+ public:
+  // adds the paths interned since the last update
+  void update(const PathTable& paths, const Topology& topology) {
+    for (int path = num_paths(); path < paths.num_paths(); path++) {
+      for (const link_t* l = paths.begin(path); l != paths.end(path); l++) {
+	int id = topology.link_id(*l);
+	if (id < 0) {
+	  std::cerr << "Link " << l->first << "->" << l->second << " not initialized.\n";
+	  exit(1);
+	}
+	ids.push_back(id);
+      }
+      offsets.push_back(ids.size());
+    }
+  }
+  const int* begin(int path) const { return ids.data() + offsets[path]; }
+  const int* end(int path) const { return ids.data() + offsets[path + 1]; }
+  int size(int path) const { return offsets[path + 1] - offsets[path]; }
+  int num_paths() const { return offsets.size() - 1; }
+  size_t capacity() const { return offsets.capacity() + ids.capacity(); }
+};
+
+// level x where a link fills up, cap = sum of count * min(level, x) over
+// its (level, count) flows plus extra * x for flows unsat throughout.
+// Selects around the median instead of sorting, expected O(n).
+// Reorders by_level. Infinite if the flows can't fill it
+inline double fill_level(std::pair< double, double >* by_level, int n,
+			 double extra, double cap) {
+  double below = 0; // count * level of flows known to be under x
+  double sharing = extra; // count of flows known to be at or over x
+  int lo = 0, hi = n;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    std::nth_element(by_level + lo, by_level + mid, by_level + hi);
+    double pivot = by_level[mid].first;
+    double left = 0, right = 0;
+    for (int i = lo; i < mid; i++) left += by_level[i].first * by_level[i].second;
+    for (int i = mid; i < hi; i++) right += by_level[i].second;
+    if (below + left + pivot * (right + sharing) >= cap) {
+      sharing += right; // full by the pivot, these are at or over x
+      hi = mid;
+    } else {
+      below += left + pivot * by_level[mid].second;
+      lo = mid + 1;
+    }
+  }
+  if (sharing == 0) return std::numeric_limits<double>::infinity();
+  return (cap - below) / sharing;
+}
+
+// Drops links that can't be the bottleneck of the flows at hand. What
+// a link carries comes in over the links just before it on the paths
+// through it, so it never carries more than their capacities summed
+// (counting each such link once), and likewise for the links just after
+// it. A link with more capacity than either sum can't fill up while one
+// of its flows is still unsat, some link next to it saturates the flow
+// first, so it never sets a rate. A flow's smallest link is never
+// dropped. Flow f's topology link ids are hop_links[flow_links_begin[f]
+// .. flow_links_begin[f+1]-1] in path order, dropped links get their
+// count in flows_on_link zeroed. Returns how many were dropped
+inline int prune_non_binding(const int* hop_links, const int* flow_links_begin,
+			     int num_flows, const Topology& topology,
+			     int* flows_on_link, Arena& arena) {
+  const double unbounded = std::numeric_limits<double>::infinity();
+  int num_topology_links = topology.num_links();
+  double* feed_in = arena.alloc<double>(num_topology_links, 0);
+  double* feed_out = arena.alloc<double>(num_topology_links, 0);
+  // (link before, link after) pairs seen so far, open addressing
+  int num_hops = flow_links_begin[num_flows];
+  size_t table_size = 64;
+  while (table_size < 2 * (size_t) num_hops) table_size *= 2;
+  size_t mask = table_size - 1;
+  int64_t* pairs = arena.alloc<int64_t>(table_size, -1);
+  for (int f = 0; f < num_flows; f++) {
+    int first = flow_links_begin[f], last = flow_links_begin[f + 1];
+    if (first == last) continue;
+    feed_in[hop_links[first]] = unbounded; // flows start on it
+    feed_out[hop_links[last - 1]] = unbounded; // and end on it
+    for (int hop = first + 1; hop < last; hop++) {
+      int before = hop_links[hop - 1], after = hop_links[hop];
+      int64_t key = (int64_t) before * num_topology_links + after;
+      size_t i = ((uint64_t) key * 0x9E3779B97F4A7C15ull >> 32) & mask;
+      while (pairs[i] >= 0 and pairs[i] != key) i = (i + 1) & mask;
+      if (pairs[i] == key) continue;
+      pairs[i] = key;
+      feed_in[after] += topology.capacity(before);
+      feed_out[before] += topology.capacity(after);
+    }
+  }
+  int num_pruned = 0;
+  for (int id = 0; id < num_topology_links; id++) {
+    if (flows_on_link[id] == 0) continue;
+    // a margin so rounding in the solver's sums can't make it bind
+    double bound = std::min(feed_in[id], feed_out[id]) * (1 + 1e-9);
+    if (topology.capacity(id) <= bound) continue;
+    flows_on_link[id] = 0;
+    num_pruned++;
+  }
+  return num_pruned;
+}
+
+template <class WeightPolicy> class WaterfillingSolver;
+
+// we only care about which links are used, order doesn't matter.
+// Links used by some flow are numbered 0..num_links-1 in topology
+// link id order, which is (src, dst) order. Everything is an array on
+// the solve's arena, nothing here is freed, the arena is reset instead.
+template <class WeightPolicy>
+class WaterfillingSolverState {
+  friend WaterfillingSolver<WeightPolicy>;
+  typedef typename WeightPolicy::count_t count_t;
+ protected:
+  int round;
+  const WeightPolicy& weights;
+  const Topology& topology;
+
+  // by flow
+  int num_flows;
+  int num_unsat_flows;
+  bool* flow_unsat;
+  double* rate_per_flow; // rate of a flow's pseudo flow
+  int* flow_saturated_in_round; // -1 while unsat
+
+  // by used link
+  int num_links;
+  int* link_ids; // topology link id
+  count_t* num_unsat_per_link; // number of unsat pseudo flows
+  double* total_flow_per_link;
+  int* link_saturated_in_round; // -1 while unsat
+  // flows on link l are active_flows[active_flows_begin[l] .. active_flows_begin[l+1]-1]
+  int* active_flows_begin;
+  int* active_flows;
+  // links on flow f's path are flow_links[flow_links_begin[f] .. flow_links_begin[f+1]-1]
+  int* flow_links_begin;
+  int* flow_links;
+  // incremental solves only: rate of the saturated pseudo flows on each
+  // link and how many flows on it are still unsat
+  KahanSum* saturated_flow_per_link;
+  int* unsat_flows_per_link;
+
+  // links on some flow's path that prune_links dropped from the above
+  int num_pruned_links;
+
+  // used links that are still unsat, in order
+  int num_unsat_links;
+  int* unsaturated_links;
+
+  KahanSum rate_of_an_unsat_flow; // sum of increments so far
+ public:
+  WaterfillingSolverState(const int* flow_paths, int num_flows,
+			  const PathLinkIds& paths,
+			  const Topology& topology,
+			  const WeightPolicy& weights,
+			  Arena& arena,
+			  bool incremental,
+			  bool prune_links = false);
+  void show();
+};
+
+// One copy of the waterfilling rounds for every weight policy.
+// The solver only borrows the topology and path link ids, Waterfilling
+// and WeightedWaterfilling hold them and run whichever instantiation fits.
+// Flows are numbered 0..num_flows-1, flow_paths[f] is f's path id in the
+// path table (updated into paths) or -1 if there is no flow f (e.g. a free flow table slot).
+// Scratch comes from the caller's arena, the caller resets it between solves.
+// An incremental solver keeps each link's load as a running sum of its
+// saturated flows plus its unsat flows at the current level, instead of
+// summing every flow on every unsat link each round. A round then only
+// touches the flows that saturate in it, much faster with many flows,
+// but rates can differ from the plain solver in the last bits.
+// A solver that prunes links first drops links that can't be the
+// bottleneck of the flows at hand (see prune_non_binding), fewer links
+// to scan each round and the same rates.
+template <class WeightPolicy>
+class WaterfillingSolver : public WaterfillingBase {
+  typedef typename WeightPolicy::count_t count_t;
+ protected:
+  const Topology& topology;
+  const PathLinkIds& paths;
+  Arena& arena;
+  bool incremental;
+  bool prune_links;
+  int num_links = 0; // of the last solve, used by some flow
+  int num_pruned_links = 0; // of those
+
+ public:
+  typedef WaterfillingSolverState<WeightPolicy> State;
+  WaterfillingSolver(const Topology& topology,
+		     const PathLinkIds& paths,
+		     Arena& arena,
+		     bool incremental = false,
+		     bool prune_links = false)
+    : topology(topology), paths(paths), arena(arena), incremental(incremental),
+      prune_links(prune_links) {}
+  int get_num_links() const { return num_links; }
+  int get_num_pruned_links() const { return num_pruned_links; }
+  // warm start from the last solve: old_level[f] is f's rate per unit
+  // weight last time, -1 if f is new or changed, removed_level the
+  // lowest level of a flow that's gone. Nothing changes below the lowest
+  // of that and the levels where links with new flows would now fill up,
+  // flows below it keep their level and incremental rounds take it from
+  // there. false (rates untouched) if no flow can be kept, otherwise
+  // *num_kept flows kept their level
+  bool do_warm_waterfilling(const int* flow_paths, int num_flows,
+			    const WeightPolicy& weights,
+			    const double* old_level, double removed_level,
+			    double* rates, int* num_kept);
+  void do_one_round_of_waterfilling(State& wfs);
+  void do_one_incremental_round(State& wfs);
+  // sets rates[f] of all flows, entries without a flow are left alone
+  void do_waterfilling(const int* flow_paths, int num_flows,
+		       const WeightPolicy& weights,
+		       double* rates,
+		       bool show = false);
+};
+
+template <class WeightPolicy>
+WaterfillingSolverState<WeightPolicy>::WaterfillingSolverState(
+ const int* flow_paths, int num_flows,
+ const PathLinkIds& paths,
+ const Topology& topology,
+ const WeightPolicy& weights,
+ Arena& arena,
+ bool incremental,
+ bool prune_links) : weights(weights), topology(topology), num_flows(num_flows) {
+  round = 0;
+  num_unsat_flows = 0;
+  flow_unsat = arena.alloc<bool>(num_flows, false);
+  rate_per_flow = arena.alloc<double>(num_flows, 0);
+  flow_saturated_in_round = arena.alloc<int>(num_flows, -1);
+
+  // topology link ids along every flow's path, and how many flows use each link
+  int num_hops = 0;
+  for (int f = 0; f < num_flows; f++) {
+    if (flow_paths[f] >= 0) num_hops += paths.size(flow_paths[f]);
+  }
+  int* hop_links = arena.alloc<int>(num_hops);
+  int* flows_on_link = arena.alloc<int>(topology.num_links(), 0);
+  flow_links_begin = arena.alloc<int>(num_flows + 1);
+  flow_links = hop_links;
+  int hop = 0;
+  for (int f = 0; f < num_flows; f++) {
+    flow_links_begin[f] = hop;
+    int path = flow_paths[f];
+    if (path < 0) continue;
+    flow_unsat[f] = true;
+    num_unsat_flows++;
+    for (const int* id = paths.begin(path); id != paths.end(path); id++) {
+      hop_links[hop++] = *id;
+      flows_on_link[*id]++;
+    }
+  }
+  flow_links_begin[num_flows] = hop;
+
+  num_pruned_links = 0;
+  if (prune_links) {
+    num_pruned_links = prune_non_binding(hop_links, flow_links_begin, num_flows,
+					 topology, flows_on_link, arena);
+  }
+
+  // number the used links, reuse flows_on_link as topology id -> used link
+  num_links = 0;
+  for (int id = 0; id < topology.num_links(); id++) {
+    if (flows_on_link[id] > 0) num_links++;
+  }
+  link_ids = arena.alloc<int>(num_links);
+  num_unsat_per_link = arena.alloc<count_t>(num_links, 0);
+  total_flow_per_link = arena.alloc<double>(num_links, 0);
+  link_saturated_in_round = arena.alloc<int>(num_links, -1);
+  active_flows_begin = arena.alloc<int>(num_links + 1);
+  active_flows = arena.alloc<int>(num_hops);
+  unsaturated_links = arena.alloc<int>(num_links);
+  int l = 0;
+  active_flows_begin[0] = 0;
+  for (int id = 0; id < topology.num_links(); id++) {
+    if (flows_on_link[id] == 0) {
+      flows_on_link[id] = -1;
+      continue;
+    }
+    link_ids[l] = id;
+    unsaturated_links[l] = l;
+    active_flows_begin[l + 1] = active_flows_begin[l] + flows_on_link[id];
+    flows_on_link[id] = l;
+    l++;
+  }
+  num_unsat_links = num_links;
+
+  // flows go on their links in flow order, active_flows_begin[l+1] counts up
+  // to its final value as link l fills. hop_links turn into used links,
+  // pruned hops are squeezed out
+  for (int i = num_links; i > 0; i--) active_flows_begin[i] = active_flows_begin[i - 1];
+  int kept_hops = 0;
+  for (int f = 0; f < num_flows; f++) {
+    int first_hop = flow_links_begin[f];
+    flow_links_begin[f] = kept_hops;
+    if (flow_paths[f] < 0) continue;
+    count_t count = weights.count(f);
+    for (hop = first_hop; hop < flow_links_begin[f + 1]; hop++) {
+      int link = flows_on_link[hop_links[hop]];
+      if (link < 0) continue;
+      hop_links[kept_hops++] = link;
+      active_flows[active_flows_begin[link + 1]++] = f;
+      num_unsat_per_link[link] += count; // number of pseudo flows
+    }
+  }
+  flow_links_begin[num_flows] = kept_hops;
+
+  saturated_flow_per_link = nullptr;
+  unsat_flows_per_link = nullptr;
+  if (incremental) {
+    saturated_flow_per_link = arena.alloc<KahanSum>(num_links, KahanSum());
+    unsat_flows_per_link = arena.alloc<int>(num_links);
+    for (int l = 0; l < num_links; l++) {
+      unsat_flows_per_link[l] = active_flows_begin[l + 1] - active_flows_begin[l];
+    }
+  }
+  return;
+}
+
+template <class WeightPolicy>
+void WaterfillingSolverState<WeightPolicy>::show() {
+  std::cout << "waterfilling state in round " << round << std::endl;
+  for (int l = 0; l < num_links; l++) {
+    link_t link = topology.get_link(link_ids[l]);
+    std::cout << "Link " << link.first
+  	      << "->" << link.second << " (";
+    std::cout << "total_flow: " << total_flow_per_link[l] << " ";
+    if (link_saturated_in_round[l] >= 0)
+      std::cout << "saturated_in_round: " << link_saturated_in_round[l] << " ";
+    std::cout << "):  ";
+
+    for (int i = active_flows_begin[l]; i < active_flows_begin[l + 1]; i++) {
+      int f = active_flows[i];
+      std::cout << f << " (";
+      std::cout << "rate: " << rate_per_flow[f] << " (x" << weights.count(f) <<") ";
+      if (flow_saturated_in_round[f] >= 0)
+	std::cout << "saturated_in_round: " << flow_saturated_in_round[f];
+      std::cout << ") ";
+    }
+    std::cout << std::endl;
+  }
+}
+
+template <class WeightPolicy>
+void WaterfillingSolver<WeightPolicy>::do_waterfilling(
+		const int* flow_paths, int num_flows,
+		const WeightPolicy& weights,
+		double* rates,
+		bool show) {
+  State wfs(flow_paths, num_flows, paths, topology, weights, arena, incremental, prune_links);
+  num_links = wfs.num_links + wfs.num_pruned_links;
+  num_pruned_links = wfs.num_pruned_links;
+  if (show) wfs.show();
+  while (wfs.num_unsat_flows > 0) {
+    if (incremental) do_one_incremental_round(wfs);
+    else do_one_round_of_waterfilling(wfs);
+  }
+  if (show) wfs.show();
+  for (int f = 0; f < num_flows; f++) {
+    if (flow_paths[f] < 0) continue;
+    rates[f] = weights.weight(f) * wfs.rate_per_flow[f];
+  }
+  return;
+}
+
+template <class WeightPolicy>
+bool WaterfillingSolver<WeightPolicy>::do_warm_waterfilling(
+		const int* flow_paths, int num_flows,
+		const WeightPolicy& weights,
+		const double* old_level, double removed_level,
+		double* rates, int* num_kept) {
+  State wfs(flow_paths, num_flows, paths, topology, weights, arena, true);
+
+  // where each link carrying new flows fills up, with the old flows at
+  // their old levels. only links that fill below the resume level so far
+  // matter, one pass tells which
+  double resume_level = removed_level;
+  std::pair< double, double >* by_level = arena.alloc< std::pair< double, double > >(
+    wfs.active_flows_begin[wfs.num_links]);
+  for (int l = 0; l < wfs.num_links; l++) {
+    double extra = 0;
+    int n = 0;
+    for (int i = wfs.active_flows_begin[l]; i < wfs.active_flows_begin[l + 1]; i++) {
+      int f = wfs.active_flows[i];
+      if (old_level[f] < 0) extra += weights.count(f);
+      else by_level[n++] = std::make_pair(old_level[f], (double) weights.count(f));
+    }
+    if (extra == 0) continue;
+    double cap = topology.capacity(wfs.link_ids[l]);
+    if (resume_level < std::numeric_limits<double>::infinity()) {
+      double load = extra * resume_level;
+      for (int i = 0; i < n; i++) load += by_level[i].second * std::min(by_level[i].first, resume_level);
+      if (load <= cap) continue;
+    }
+    resume_level = std::min(resume_level, fill_level(by_level, n, extra, cap));
+  }
+  // flows that saturated together can have levels a rounding error
+  // apart, resume a little lower so they're all still unsat
+  resume_level *= 1 - 1e-9;
+
+  // the state the solver was in at resume_level
+  int kept = 0;
+  for (int f = 0; f < num_flows; f++) {
+    if (flow_paths[f] < 0 or old_level[f] < 0 or old_level[f] >= resume_level) continue;
+    count_t count = weights.count(f);
+    wfs.rate_per_flow[f] = old_level[f];
+    wfs.flow_unsat[f] = false;
+    wfs.num_unsat_flows--;
+    for (int h = wfs.flow_links_begin[f]; h < wfs.flow_links_begin[f + 1]; h++) {
+      int link = wfs.flow_links[h];
+      wfs.saturated_flow_per_link[link].add(old_level[f] * count);
+      if (--wfs.unsat_flows_per_link[link] == 0) wfs.num_unsat_per_link[link] = 0;
+      else wfs.num_unsat_per_link[link] -= count;
+    }
+    kept++;
+  }
+  if (kept == 0) return false;
+  wfs.rate_of_an_unsat_flow.add(resume_level);
+  while (wfs.num_unsat_flows > 0) do_one_incremental_round(wfs);
+  for (int f = 0; f < num_flows; f++) {
+    if (flow_paths[f] < 0) continue;
+    rates[f] = weights.weight(f) * wfs.rate_per_flow[f];
+  }
+  *num_kept = kept;
+  return true;
+}
+
+template <class WeightPolicy>
+void WaterfillingSolver<WeightPolicy>::do_one_round_of_waterfilling
+(State& wfs) {
+  // the actual waterfilling algorithm
+  // calculate fair shares C/N for all unsaturated links, keep the
+  // first smallest. there can be links with no unsat flows
+  int min_fair_share_link = -1; // used link
+  int min_fair_share_pos = -1; // its place in unsaturated_links
+  double min_fair_share_value = 0;
+  for (int u = 0; u < wfs.num_unsat_links; u++) {
+    int link = wfs.unsaturated_links[u];
+    double rem_cap = topology.capacity(wfs.link_ids[link]) - wfs.total_flow_per_link[link];
+    count_t num_unsat = wfs.num_unsat_per_link[link]; // number of unsat pseudo flows
+    if (num_unsat > 0) {
+      double fair_share = rem_cap/num_unsat; // fair share per unsat pseudo flow
+      if (min_fair_share_link < 0 or fair_share < min_fair_share_value) {
+	min_fair_share_link = link;
+	min_fair_share_pos = u;
+	min_fair_share_value = fair_share;
+      }
+    }
+  }
+
+  if (min_fair_share_link < 0) {
+    std::cerr << "Didn't find any unsat link carrying an unsat flow.\n";
+    exit(1);
+  }
+  const link_t min_link = topology.get_link(wfs.link_ids[min_fair_share_link]);
+
+    // (re)set rate of all unsat flows to sum of all min_fair_share_values till now
+    double increment = min_fair_share_value > 0 ? min_fair_share_value : 0;
+    wfs.rate_of_an_unsat_flow.add(increment);
+    const double rate_of_an_unsat_flow = wfs.rate_of_an_unsat_flow.sum; // rate of an unsat pseudo flow
+    for (int f = 0; f < wfs.num_flows; f++) {
+      if (wfs.flow_unsat[f]) wfs.rate_per_flow[f] = rate_of_an_unsat_flow; // rate of its pseudo flow
+    }
+
+    // remove min fair share link and all its unsat flows
+    count_t num_unsat = wfs.num_unsat_per_link[min_fair_share_link];
+    count_t backup_num_unsat = 0;
+    for (int i = wfs.active_flows_begin[min_fair_share_link];
+	 i < wfs.active_flows_begin[min_fair_share_link + 1]; i++) {
+      int f = wfs.active_flows[i];
+      if (wfs.flow_unsat[f]) {
+	backup_num_unsat += wfs.weights.count(f);
+	wfs.flow_saturated_in_round[f] = wfs.round;
+	wfs.flow_unsat[f] = false;
+	wfs.num_unsat_flows--;
+      }
+    }
+
+    if (counts_differ(backup_num_unsat, num_unsat)) {
+      std::cerr << "min fair share link " << get_str(min_link)
+		<< " num_unsat " << num_unsat
+		<< " not equal to " << backup_num_unsat
+		<< " (book-keeping error?)\n";
+      exit(1);
+    }
+
+    std::copy(wfs.unsaturated_links + min_fair_share_pos + 1,
+	      wfs.unsaturated_links + wfs.num_unsat_links,
+	      wfs.unsaturated_links + min_fair_share_pos);
+    wfs.num_unsat_links--;
+    wfs.link_saturated_in_round[min_fair_share_link] = wfs.round;
+
+    // update total flow and num_unsat on every unsat link
+    // to calculate fair share in the next round
+    // unsat links that lost all their unsat flows in this round
+    // (cuz the flows also passed through min_fair_share link) will
+    // get a new total_flow but we won't consider them in our
+    // list of fair_share links next round, once num_unsat is 0
+    for (int u = 0; u < wfs.num_unsat_links; u++) {
+      int link = wfs.unsaturated_links[u];
+      KahanSum total_flow;
+      num_unsat = 0;
+      for (int i = wfs.active_flows_begin[link]; i < wfs.active_flows_begin[link + 1]; i++) {
+	int f = wfs.active_flows[i];
+	// sum of rates of pseudoflows
+	total_flow.add(wfs.rate_per_flow[f] * wfs.weights.count(f));
+	if (wfs.flow_unsat[f]) {
+	  num_unsat += wfs.weights.count(f);
+	}
+      }
+      wfs.total_flow_per_link[link] = total_flow.sum;
+      // re(set) num_unsat flows using link
+      wfs.num_unsat_per_link[link] = num_unsat;
+    }
+
+    wfs.round++;
+  // at the end wfs will have max-min rates for all (pseudo) flows
+}
+
+template <class WeightPolicy>
+void WaterfillingSolver<WeightPolicy>::do_one_incremental_round
+(State& wfs) {
+  // same rounds, but a link's load is its saturated flows' running sum
+  // plus its unsat pseudo flows at the level reached so far
+  const double level = wfs.rate_of_an_unsat_flow.sum;
+  int min_fair_share_link = -1;
+  int min_fair_share_pos = -1;
+  double min_fair_share_value = 0;
+  // links that lost all their unsat flows can't be picked again,
+  // drop them from the list (keeping its order) as we go
+  int num_kept = 0;
+  for (int u = 0; u < wfs.num_unsat_links; u++) {
+    int link = wfs.unsaturated_links[u];
+    if (wfs.unsat_flows_per_link[link] == 0) continue;
+    wfs.unsaturated_links[num_kept] = link;
+    count_t num_unsat = wfs.num_unsat_per_link[link];
+    double rem_cap = topology.capacity(wfs.link_ids[link])
+      - wfs.saturated_flow_per_link[link].sum - level * num_unsat;
+    double fair_share = rem_cap/num_unsat;
+    if (min_fair_share_link < 0 or fair_share < min_fair_share_value) {
+      min_fair_share_link = link;
+      min_fair_share_pos = num_kept;
+      min_fair_share_value = fair_share;
+    }
+    num_kept++;
+  }
+  wfs.num_unsat_links = num_kept;
+
+  if (min_fair_share_link < 0) {
+    std::cerr << "Didn't find any unsat link carrying an unsat flow.\n";
+    exit(1);
+  }
+
+  double increment = min_fair_share_value > 0 ? min_fair_share_value : 0;
+  wfs.rate_of_an_unsat_flow.add(increment);
+  const double rate_of_an_unsat_flow = wfs.rate_of_an_unsat_flow.sum;
+
+  // saturate the min fair share link's unsat flows at this level,
+  // and take them off the unsat counts of every link they use
+  count_t num_unsat = wfs.num_unsat_per_link[min_fair_share_link];
+  count_t backup_num_unsat = 0;
+  for (int i = wfs.active_flows_begin[min_fair_share_link];
+       i < wfs.active_flows_begin[min_fair_share_link + 1]; i++) {
+    int f = wfs.active_flows[i];
+    if (not wfs.flow_unsat[f]) continue;
+    count_t count = wfs.weights.count(f);
+    backup_num_unsat += count;
+    wfs.rate_per_flow[f] = rate_of_an_unsat_flow;
+    wfs.flow_saturated_in_round[f] = wfs.round;
+    wfs.flow_unsat[f] = false;
+    wfs.num_unsat_flows--;
+    for (int h = wfs.flow_links_begin[f]; h < wfs.flow_links_begin[f + 1]; h++) {
+      int link = wfs.flow_links[h];
+      wfs.saturated_flow_per_link[link].add(rate_of_an_unsat_flow * count);
+      // exactly 0 once the last one is gone, double counts may not cancel
+      if (--wfs.unsat_flows_per_link[link] == 0) wfs.num_unsat_per_link[link] = 0;
+      else wfs.num_unsat_per_link[link] -= count;
+    }
+  }
+
+  if (counts_differ(backup_num_unsat, num_unsat)) {
+    const link_t min_link = topology.get_link(wfs.link_ids[min_fair_share_link]);
+    std::cerr << "min fair share link " << get_str(min_link)
+	      << " num_unsat " << num_unsat
+	      << " not equal to " << backup_num_unsat
+	      << " (book-keeping error?)\n";
+    exit(1);
+  }
+
+  std::copy(wfs.unsaturated_links + min_fair_share_pos + 1,
+	    wfs.unsaturated_links + wfs.num_unsat_links,
+	    wfs.unsaturated_links + min_fair_share_pos);
+  wfs.num_unsat_links--;
+  wfs.link_saturated_in_round[min_fair_share_link] = wfs.round;
+  wfs.round++;
+}
+
+#endif
@@ -3,230 +3,326 @@
 #include <iostream>
 #include <sstream>
 #include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
 
-WeightedWaterfilling::WeightedWaterfilling(const std::map< link_t, double> & link_capacities) : link_capacities(link_capacities) {};
+// larger integer weights are solved as doubles. class counts are int64_t,
+// 2^16 times any number of int-counted flows can't overflow them
+static const double max_class_weight = 1 << 16;
 
-std::string WeightedWaterfilling::get_str(const link_t& link) {
-  std::stringstream ss;
-  ss << link.first << "->" << link.second;
-  return ss.str();
-}
+WeightedWaterfilling::WeightedWaterfilling(const Topology& topology,
+					   PathTable& paths) : topology(topology), paths(paths) {};
+
+WeightedWaterfilling::WeightedWaterfilling(const std::map< link_t, double> & link_capacities,
+					   PathTable& paths)
+  : owned_topology(Topology::from_capacities(link_capacities)),
+    topology(*owned_topology), paths(paths) {};
 
-double WeightedWaterfilling::get_sum(const std::vector<double>& summands) {
-  // double sum = 0;
-  //for (const auto& s : summands) sum += s;
-  // kahan summation from wiki
-  double sum = 0.0;
-  double c = 0.0; // running compensation for lost precision
-  for (const auto& s : summands) {
-    double y = s - c;
-    double t = sum + y;
-    c = (t - sum) - y;
-    sum = t;
+bool WeightedWaterfilling::use_tree_solver(const int* flow_paths, int num_flows) {
+  if (solver_mode == SolverMode::general) return false;
+  if (solver_mode == SolverMode::tree_if_detected) {
+    if (two_tier < 0) two_tier = is_two_tier_tree(topology);
+    if (not two_tier) return false;
   }
-  return sum;
+  return TreeWaterfillingSolver<UnitWeights>::fits(flow_paths, num_flows, path_links);
 }
 
-void WeightedWaterfillingState::show() {
-  std::cout << "waterfilling state in round " << round << std::endl;
-  for (const auto& l : active_flows_per_link) {
-    std::cout << "Link " << l.first.first 
-  	      << "->" << l.first.second << " (";
-    if (total_flow_per_link.count(l.first))
-      std::cout << "total_flow: " << total_flow_per_link.at(l.first) << " ";          
-    if (link_saturated_in_round.count(l.first))
-      std::cout << "saturated_in_round: " << link_saturated_in_round.at(l.first) << " ";    
-    std::cout << "):  ";
-
-    for (const auto& f : l.second) {
-      std::cout << f << " (";
-      if (rate_per_flow.count(f)) {
-	double weight = flow_to_weight.at(f);
-	std::cout << "rate: " << rate_per_flow.at(f) << " (x" << weight <<") ";
-      }
-      if (flow_saturated_in_round.count(f)) 
-	std::cout << "saturated_in_round: " << flow_saturated_in_round.at(f); 
-      std::cout << ") ";
+// the general solver's rates for the same flows, they have to agree
+// with the tree solver's up to rounding
+template <class WeightPolicy>
+static void check_against_general(const Topology& topology, const PathLinkIds& path_links,
+				  Arena& arena, bool incremental,
+				  const int* flow_paths, int num_flows,
+				  const WeightPolicy& weights, const double* rates) {
+  double* general_rates = arena.alloc<double>(num_flows, 0);
+  WaterfillingSolver<WeightPolicy> solver(topology, path_links, arena, incremental);
+  solver.do_waterfilling(flow_paths, num_flows, weights, general_rates);
+  for (int f = 0; f < num_flows; f++) {
+    if (flow_paths[f] < 0) continue;
+    if (std::abs(rates[f] - general_rates[f]) > 1e-9 * std::max(1.0, std::abs(general_rates[f]))) {
+      std::cerr << "tree solver gave flow " << f << " rate " << rates[f]
+		<< ", general solver " << general_rates[f] << std::endl;
+      exit(1);
     }
-    std::cout << std::endl;
   }
 }
-void WeightedWaterfilling::do_waterfilling(
-		const std::map< int, std::vector< link_t > > &
-		flow_to_path,
-		const std::map< int, double > &
-		flow_to_weight,
-		std::map< int, double >& rates) {
-  //std::unique_ptr<WeightedWaterfillingState> wfs(new WeightedWaterfillingState(flow_to_path));
-  WeightedWaterfillingState wfs(flow_to_path, flow_to_weight); 
-  //wfs.show();
-  while (wfs.unsaturated_flows.size() > 0) {
-    do_one_round_of_waterfilling(wfs);
-    //    wfs.show();
+
+template <class WeightPolicy>
+void WeightedWaterfilling::solve(
+		const int* flow_paths, int num_flows,
+		const WeightPolicy& per_flow,
+		const int* multiplicity,
+		double* rates) {
+  if (use_tree_solver(flow_paths, num_flows)) {
+    num_tree_solves++;
+    if (multiplicity) {
+      AggregatedWeights<WeightPolicy> weights(per_flow, multiplicity);
+      TreeWaterfillingSolver< AggregatedWeights<WeightPolicy> > solver(topology, path_links, arena);
+      solver.do_waterfilling(flow_paths, num_flows, weights, rates);
+      if (check_tree) check_against_general(topology, path_links, arena, incremental,
+					    flow_paths, num_flows, weights, rates);
+    } else {
+      TreeWaterfillingSolver<WeightPolicy> solver(topology, path_links, arena);
+      solver.do_waterfilling(flow_paths, num_flows, per_flow, rates);
+      if (check_tree) check_against_general(topology, path_links, arena, incremental,
+					    flow_paths, num_flows, per_flow, rates);
+    }
+    return;
   }
-  //  wfs.show();
-  for (auto f : wfs.rate_per_flow) {
-    double weight = flow_to_weight.at(f.first);
-    rates[f.first] = weight * f.second;
+  if (multiplicity) {
+    WaterfillingSolver< AggregatedWeights<WeightPolicy> > solver(topology, path_links, arena,
+								 incremental or warm_start, prune_links);
+    AggregatedWeights<WeightPolicy> weights(per_flow, multiplicity);
+    solver.do_waterfilling(flow_paths, num_flows, weights, rates);
+    num_links_solved += solver.get_num_links();
+    num_links_pruned += solver.get_num_pruned_links();
+  } else {
+    WaterfillingSolver<WeightPolicy> solver(topology, path_links, arena, incremental or warm_start, prune_links);
+    solver.do_waterfilling(flow_paths, num_flows, per_flow, rates);
+    num_links_solved += solver.get_num_links();
+    num_links_pruned += solver.get_num_pruned_links();
   }
-  return;
 }
 
-void WeightedWaterfilling::do_one_round_of_waterfilling
-(WeightedWaterfillingState& wfs) {
-  // the actual waterfilling algorithm
-  std::vector<double> fair_share_values;
-  std::vector<link_t> fair_share_links;
-  // calculate fair shares C/N for all unsaturated links
-  // there can be links with no unsat flows
-  for (auto& link : wfs.unsaturated_links) {
-    if (link_capacities.count(link) == 0 || 
-	wfs.total_flow_per_link.count(link) == 0 || 
-	wfs.num_unsat_per_link.count(link) == 0) {
-      std::cerr << "Link " << link.first << "->" << link.second << " not initialized.\n";
-      exit(1);
-    }
-    double rem_cap = link_capacities.at(link) - wfs.total_flow_per_link.at(link);
-    int num_unsat = wfs.num_unsat_per_link.at(link); // number of unsat pseudo flows
-    if (num_unsat > 0) {
-      double fair_share = rem_cap/num_unsat; // fair share per unsat pseudo flow
-      fair_share_values.push_back(fair_share);
-      fair_share_links.push_back(link);
+void WeightedWaterfilling::solve_any_weights(
+		const int* flow_paths, const double* flow_weights,
+		int num_flows,
+		const int* multiplicity,
+		double* rates) {
+  bool unit_weights = true;
+  bool class_weights = true;
+  for (int f = 0; f < num_flows; f++) {
+    if (flow_paths[f] < 0) continue;
+    double weight = flow_weights[f];
+    if (weight != 1) unit_weights = false;
+    if (weight < 1 or weight > max_class_weight or weight != std::floor(weight)) {
+      class_weights = false;
+      break;
     }
   }
 
-  if (fair_share_values.size() == 0) {
-    std::cerr << "Didn't find any unsat link carrying an unsat flow.\n";
-    exit(1);
+  if (unit_weights) {
+    solve(flow_paths, num_flows, UnitWeights(), multiplicity, rates);
+  } else if (class_weights) {
+    solve(flow_paths, num_flows, ClassWeights(flow_weights), multiplicity, rates);
+  } else {
+    solve(flow_paths, num_flows, DoubleWeights(flow_weights), multiplicity, rates);
   }
-  auto min_fair_share_it = std::min_element(fair_share_values.begin(), fair_share_values.end());
-  unsigned arg_min = min_fair_share_it - fair_share_values.begin();
-  const double min_fair_share_value = *min_fair_share_it;
-  const link_t& min_fair_share_link = fair_share_links.at(arg_min);
+}
 
-    // std::cout << "min_fair_share_value is " << min_fair_share_value << " for link "
-    // 	      << get_str(min_fair_share_link) << "\n";
+// the solver reads weights and writes rates as doubles,
+// float32 arrays (compact mode) go through copies on the arena
+static const double* as_doubles(const double* values, int, Arena&) {
+  return values;
+}
+static const double* as_doubles(const float* values, int n, Arena& arena) {
+  double* copy = arena.alloc<double>(n);
+  std::copy(values, values + n, copy);
+  return copy;
+}
+static double* rates_buffer(double* rates, int, Arena&) { return rates; }
+static double* rates_buffer(float*, int n, Arena& arena) {
+  return arena.alloc<double>(n, 0);
+}
+static void copy_rates(const double*, double*, const int*, int) {}
+static void copy_rates(const double* from, float* to,
+		       const int* flow_paths, int n) {
+  for (int f = 0; f < n; f++) {
+    if (flow_paths[f] >= 0) to[f] = from[f];
+  }
+}
 
-    // (re)set rate of all unsat flows to sum of all min_fair_share_values till now
-    double increment = min_fair_share_value > 0 ? min_fair_share_value : 0;
-    wfs.rate_increments.push_back(increment);
-    const double rate_of_an_unsat_flow = get_sum(wfs.rate_increments); // rate of an unsat pseudo flow
-    for (auto f : wfs.unsaturated_flows) {
-      wfs.rate_per_flow.at(f) = rate_of_an_unsat_flow; // rate of its pseudo flow
+bool WeightedWaterfilling::solve_warm(const int* flow_paths, const double* flow_weights,
+				      int num_flows, double* rates) {
+  // what changed since the last solve, by flow number
+  double removed_level = std::numeric_limits<double>::infinity();
+  double* old_level = arena.alloc<double>(num_flows, -1);
+  int num_warm = warm_path.size();
+  int num_active = 0, num_changed = 0;
+  for (int f = 0; f < std::max(num_flows, num_warm); f++) {
+    int path = f < num_flows ? flow_paths[f] : -1;
+    bool same = f < num_warm and f < num_flows and warm_path[f] == path
+      and (path < 0 or warm_weight[f] == flow_weights[f]);
+    if (f < num_warm and warm_path[f] >= 0 and not same) {
+      removed_level = std::min(removed_level, warm_level[f]);
     }
+    if (path < 0) continue;
+    num_active++;
+    if (same) old_level[f] = warm_level[f];
+    else num_changed++;
+  }
+  num_warm_flows += num_active;
+  // with most flows new the solve is mostly from scratch anyway
+  if (num_warm == 0 or 2 * num_changed > num_active) return false;
 
-    // remove min fair share link and all its unsat flows
-    if (wfs.active_flows_per_link.count(min_fair_share_link) == 0) {
-      std::cerr << "min_fair_share link " << get_str(min_fair_share_link) << " doens't have active flows.\n";
-      exit(1);
+  int num_kept = num_active;
+  if (num_changed > 0 or removed_level < std::numeric_limits<double>::infinity()) {
+    DoubleWeights weights(flow_weights);
+    WaterfillingSolver<DoubleWeights> solver(topology, path_links, arena, true);
+    if (not solver.do_warm_waterfilling(flow_paths, num_flows, weights, old_level,
+					removed_level, rates, &num_kept)) return false;
+  } else {
+    // nothing changed
+    for (int f = 0; f < num_flows; f++) {
+      if (flow_paths[f] >= 0) rates[f] = old_level[f] * flow_weights[f];
     }
+  }
+  num_warm_hits++;
+  num_warm_flows_kept += num_kept;
+  return true;
+}
 
-    int num_unsat = wfs.num_unsat_per_link.at(min_fair_share_link);
-    int backup_num_unsat = 0;
-    std::vector<int> unsat_flows_removed;
-    for (auto f : wfs.active_flows_per_link.at(min_fair_share_link)) {
-      auto flow_it = wfs.unsaturated_flows.find(f);
-      if (flow_it != wfs.unsaturated_flows.end()) {
-	double weight = wfs.flow_to_weight.at(f);
-	backup_num_unsat += weight;
-	wfs.flow_saturated_in_round[f] = wfs.round;
-	wfs.unsaturated_flows.erase(f);
-	unsat_flows_removed.push_back(f);
+template <class Weight, class Rate>
+void WeightedWaterfilling::solve_flows(
+		const int* flow_paths, const Weight* flow_weights,
+		int num_flows, Rate* rates) {
+  arena.reset();
+  path_links.update(paths, topology);
+  if (warm_start) {
+    // solved in doubles, each solve's levels start the next
+    const double* weights = as_doubles(flow_weights, num_flows, arena);
+    double* flow_rates = rates_buffer(rates, num_flows, arena);
+    if (solve_warm(flow_paths, weights, num_flows, flow_rates)) {
+      // warm solves don't group flows, each is its own entity
+      for (int f = 0; f < num_flows; f++) {
+	if (flow_paths[f] < 0) continue;
+	num_flows_solved++;
+	num_entities_solved++;
       }
+    } else {
+      num_warm_misses++;
+      solve_cold(flow_paths, weights, num_flows, flow_rates);
     }
-
-    if (backup_num_unsat != num_unsat) {
-      std::cerr << "min fair share link " << get_str(min_fair_share_link)
-		<< " num_unsat " << num_unsat 
-		<< " not equal to " << backup_num_unsat
-		<< " (book-keeping error?)\n";
-      exit(1);
+    warm_path.assign(flow_paths, flow_paths + num_flows);
+    warm_weight.assign(weights, weights + num_flows);
+    warm_level.resize(num_flows);
+    for (int f = 0; f < num_flows; f++) {
+      if (flow_paths[f] >= 0) warm_level[f] = flow_rates[f] / weights[f];
     }
+    copy_rates(flow_rates, rates, flow_paths, num_flows);
+    return;
+  }
+  solve_cold(flow_paths, flow_weights, num_flows, rates);
+}
 
-    auto link_it = wfs.unsaturated_links.find(min_fair_share_link);
-    if (link_it == wfs.unsaturated_links.end()) {
-      std::cerr << "min fair share link " << get_str(min_fair_share_link)
-		<< " not in set of unsat links.\n";
-      exit(1);
+template <class Weight, class Rate>
+void WeightedWaterfilling::solve_cold(
+		const int* flow_paths, const Weight* flow_weights,
+		int num_flows, Rate* rates) {
+  if (not aggregate_flows) {
+    for (int f = 0; f < num_flows; f++) {
+      if (flow_paths[f] < 0) continue;
+      num_flows_solved++;
+      num_entities_solved++;
     }
+    double* flow_rates = rates_buffer(rates, num_flows, arena);
+    solve_any_weights(flow_paths, as_doubles(flow_weights, num_flows, arena),
+		      num_flows, nullptr, flow_rates);
+    copy_rates(flow_rates, rates, flow_paths, num_flows);
+    return;
+  }
 
-    wfs.unsaturated_links.erase(link_it);
-    wfs.link_saturated_in_round[min_fair_share_link] = wfs.round;
-
-    // update total flow and num_unsat on every unsat link
-    // to calculate fair share in the next round
-    // unsat links that lost all their unsat flows in this round
-    // (cuz the flows also passed through min_fair_share link) will
-    // get a new total_flow but we won't consider them in our
-    // list of fair_share links next round, once num_unsat is 0
-    for (auto& l : wfs.unsaturated_links) {
-      if (wfs.active_flows_per_link.count(l) == 0) {
-	std::cerr << "link " << get_str(l) << " doesn't have active flows.\n";
-	exit(1);
-      }
-      std::vector<double> flow_rates;
-      for (auto f : wfs.active_flows_per_link.at(l)) {
-	if (wfs.rate_per_flow.count(f) == 0) {
-	  std::cerr << "flow " << f << " doesn't have a rate.\n";
-	  exit(1);
-	}
-	double weight = wfs.flow_to_weight.at(f);
-	flow_rates.push_back(wfs.rate_per_flow.at(f) * weight); // sum of rates of pseudoflows
-      }
-      wfs.total_flow_per_link.at(l) = get_sum(flow_rates);
+  // group flows by (path, weight), entity e stands for multiplicity[e] flows.
+  // entities are numbered in order of their first flow and found through
+  // an open addressing table of entity ids, all scratch is on the arena
+  size_t table_size = 64;
+  while (table_size < 2 * (size_t) num_flows) table_size *= 2;
+  size_t mask = table_size - 1;
+  int* entity_table = arena.alloc<int>(table_size, -1);
+  int* entity_paths = arena.alloc<int>(num_flows);
+  double* entity_weights = arena.alloc<double>(num_flows);
+  int* multiplicity = arena.alloc<int>(num_flows);
+  int* entity_of_flow = arena.alloc<int>(num_flows, -1);
+  int num_entities = 0;
+  for (int f = 0; f < num_flows; f++) {
+    int path = flow_paths[f];
+    if (path < 0) continue;
+    num_flows_solved++;
+    double weight = flow_weights[f];
+    size_t i = ((unsigned) path * 2654435761u ^ std::hash<double>()(weight)) & mask;
+    while (entity_table[i] >= 0 and
+	   (entity_paths[entity_table[i]] != path or
+	    entity_weights[entity_table[i]] != weight)) {
+      i = (i + 1) & mask;
     }
+    int entity = entity_table[i];
+    if (entity < 0) {
+      entity = num_entities++;
+      entity_table[i] = entity;
+      entity_paths[entity] = path;
+      entity_weights[entity] = weight;
+      multiplicity[entity] = 1;
+    } else {
+      multiplicity[entity]++;
+    }
+    entity_of_flow[f] = entity;
+  }
+  num_entities_solved += num_entities;
 
-    // re(set) num_unsat flows using link
-    wfs.num_unsat_per_link.clear();
-    for (auto l : wfs.unsaturated_links) {
-      if (wfs.active_flows_per_link.count(l) == 0) {
-	std::cerr << "link " << get_str(l) << " doesn't have active flows.\n";
-	exit(1);
-      }
+  double* entity_rates = arena.alloc<double>(num_entities, 0);
+  uint64_t key = 0;
+  if (memo) key = RateMemo::signature(entity_paths, entity_weights, multiplicity, num_entities);
+  if (not memo or not memo->lookup(key, entity_paths, entity_weights, multiplicity,
+				   num_entities, entity_rates)) {
+    solve_any_weights(entity_paths, entity_weights, num_entities,
+		      multiplicity, entity_rates);
+    if (memo) memo->insert(key, entity_paths, entity_weights, multiplicity,
+			   num_entities, entity_rates);
+  }
 
-      num_unsat = 0;
-      for (auto f : wfs.active_flows_per_link.at(l)) {
-	if (wfs.unsaturated_flows.count(f) > 0) {
-	  double weight = wfs.flow_to_weight.at(f);
-	  num_unsat += weight;
-	}
-      }     
-      wfs.num_unsat_per_link[l] = num_unsat;
-    }
+  // every flow in a class gets the class's rate
+  for (int f = 0; f < num_flows; f++) {
+    if (entity_of_flow[f] >= 0) rates[f] = entity_rates[entity_of_flow[f]];
+  }
+  return;
+}
 
-    wfs.round++;
-  // at the end wfs will have max-min rates for all (pseudo) flows
-};
+void WeightedWaterfilling::do_waterfilling(
+		const int* flow_paths, const double* flow_weights,
+		int num_flows, double* rates) {
+  solve_flows(flow_paths, flow_weights, num_flows, rates);
+}
 
+void WeightedWaterfilling::do_waterfilling(
+		const int* flow_paths, const float* flow_weights,
+		int num_flows, float* rates) {
+  solve_flows(flow_paths, flow_weights, num_flows, rates);
+}
 
-WeightedWaterfillingState::WeightedWaterfillingState(
- const std::map< int, std::vector< link_t > > & 
- flow_to_path,
- const std::map< int, double> &
- flow_to_weight) : flow_to_weight(flow_to_weight) {
-  round = 0;
-  //std::cout << "setting up wf state\n";
-  for (auto f : flow_to_path) {
-    //std::cout << "flow " << f.first << "\n";
-    unsaturated_flows.insert(f.first);
-    double weight = flow_to_weight.at(f.first);
-    rate_per_flow[f.first] = 0;
-    for (auto l : f.second) {
-      auto link_it = unsaturated_links.insert(l); 
-      //first=it to link, second=true if inserted
-      auto link = *(link_it.first);
-      if (link_it.second) {
-      	num_unsat_per_link[link] = 0;
-      	total_flow_per_link[link] = 0;
-      }
-      num_unsat_per_link.at(link) += weight; // number of pseudo flows
-      // std::cout << "push flow " << f.first << "onto "  
-      // 		<< link.first << "->" << link.second
-      // 		<< "\n";
-      active_flows_per_link[link].push_back(f.first);      
-    }
+void WeightedWaterfilling::do_waterfilling(
+		const std::map< int, int > &
+		flow_to_path,
+		const std::map< int, double > &
+		flow_to_weight,
+		std::map< int, double >& rates) {
+  // number flows by position
+  std::vector< int > flow_paths;
+  std::vector< double > flow_weights;
+  for (const auto& f : flow_to_path) {
+    flow_paths.push_back(f.second);
+    flow_weights.push_back(flow_to_weight.at(f.first));
   }
-  return;
+  std::vector< double > flow_rates(flow_paths.size(), 0);
+  do_waterfilling(flow_paths.data(), flow_weights.data(), flow_paths.size(),
+		  flow_rates.data());
+  int i = 0;
+  for (const auto& f : flow_to_path) {
+    rates[f.first] = flow_rates.at(i++);
+  }
+}
+
+void WeightedWaterfilling::do_waterfilling(
+		const std::map< int, std::vector< link_t > > &
+		flow_to_path,
+		const std::map< int, double > &
+		flow_to_weight,
+		std::map< int, double >& rates) {
+  std::map< int, int > flow_to_path_id;
+  for (const auto& f : flow_to_path) {
+    flow_to_path_id[f.first] = paths.intern(f.second);
+  }
+  do_waterfilling(flow_to_path_id, flow_to_weight, rates);
 }
 
 int main_ignore() {
@@ -1,51 +1,145 @@
-#include <map>
-#include <vector>
-#include <set>
-#include <utility> // std::pair
-typedef std::pair<int, int> link_t;
+#ifndef WEIGHTED_WATERFILLING_H
+#define WEIGHTED_WATERFILLING_H
 
-//typedef int link_t;
+#include "waterfilling_solver.h"
+#include "tree_waterfilling.h"
+#include "rate_memo.h"
+#include <memory>
 
-class WeightedWaterfilling;
-
-// we only care about which links are used, order doesn't matter
-class WeightedWaterfillingState {
-  friend WeightedWaterfilling;
- protected:
-  void show();
-  int round;
-  std::set< link_t > unsaturated_links; 
-  std::set< int > unsaturated_flows;
-  std::map< link_t, int > num_unsat_per_link;
-  std::map< link_t, double > total_flow_per_link;
-  std::map< link_t, std::vector< int > > active_flows_per_link;
-  std::map< int, double > rate_per_flow;
-  std::map< int, double > flow_to_weight; // weight should be an integer, assume flow is actually w flows
-  std::map< int, int > flow_saturated_in_round;
-  std::map< link_t, int > link_saturated_in_round;
-
-
-  std::vector<double> rate_increments;
- public:
-  WeightedWaterfillingState(const std::map<int, std::vector< link_t > > & flow_to_path,
-			    const std::map<int, double > & flow_to_weight);
-};
+// which solver runs the waterfilling. tree_if_detected and tree use
+// TreeWaterfillingSolver (tree_waterfilling.h) when every path has at
+// most 4 hops and WaterfillingSolver otherwise, tree_if_detected only
+// on a topology is_two_tier_tree() accepts, tree on any
+enum class SolverMode { general, tree_if_detected, tree };
 
 // say 3 active flows f1, F2, F3, all we know is 
 // f1's weight is twice that of each of F2, F3
 // maybe f1 can act like two flows and F2, F3 
-class WeightedWaterfilling {
+class WeightedWaterfilling : public WaterfillingBase {
  protected:
-  std::map< link_t, double> link_capacities;
-  //std::map<int, std::vector< link_t > > flow_to_path;
-  //std::map<int, double > flow_to_weight;
+  std::unique_ptr<Topology> owned_topology;
+  const Topology& topology; // not copied, may be a mapped snapshot
+  PathTable& paths;
+  Arena arena; // scratch for one solve, reset at the start of the next
+  PathLinkIds path_links;
+
+  // flows with identical (path, weight) are solved as one entity
+  bool aggregate_flows = true;
+  // keep link loads as running sums (see WaterfillingSolver)
+  bool incremental = false;
+  SolverMode solver_mode = SolverMode::general;
+  int two_tier = -1; // is_two_tier_tree(topology), -1 until we need it
+  // run the general solver as well and exit if they disagree
+  bool check_tree = false;
+  long num_tree_solves = 0;
+  // drop links that can't bind before solving (see prune_non_binding)
+  bool prune_links = false;
+  long num_links_solved = 0;
+  long num_links_pruned = 0;
+  // warm starts (see set_warm_start), the last solve's path, weight and
+  // level (rate per unit weight) by flow number
+  bool warm_start = false;
+  std::vector< int > warm_path;
+  std::vector< double > warm_weight;
+  std::vector< double > warm_level;
+  long num_warm_hits = 0;
+  long num_warm_misses = 0;
+  long num_warm_flows = 0; // flows in solves that tried to warm start
+  long num_warm_flows_kept = 0; // of those, flows that kept their level
+  std::unique_ptr<RateMemo> memo; // solved class sets, if on
+  long num_flows_solved = 0;
+  long num_entities_solved = 0;
+
+  template <class WeightPolicy>
+  void solve(const int* flow_paths, int num_flows,
+	     const WeightPolicy& per_flow,
+	     const int* multiplicity,
+	     double* rates);
+  bool use_tree_solver(const int* flow_paths, int num_flows);
+  bool solve_warm(const int* flow_paths, const double* flow_weights,
+		  int num_flows, double* rates);
+  template <class Weight, class Rate>
+  void solve_flows(const int* flow_paths, const Weight* flow_weights,
+		   int num_flows, Rate* rates);
+  template <class Weight, class Rate>
+  void solve_cold(const int* flow_paths, const Weight* flow_weights,
+		  int num_flows, Rate* rates);
+  void solve_any_weights(const int* flow_paths, const double* flow_weights,
+			 int num_flows,
+			 const int* multiplicity,
+			 double* rates);
 
  public:
-  WeightedWaterfilling(const std::map< link_t, double>& link_capacities);
-  static std::string get_str(const link_t & link);
-  static double get_sum(const std::vector<double> & summands);
-  void do_one_round_of_waterfilling(WeightedWaterfillingState& wfs);
+  // topology has to outlive us
+  WeightedWaterfilling(const Topology& topology,
+		       PathTable& paths = PathTable::global());
+  WeightedWaterfilling(const std::map< link_t, double>& link_capacities,
+		       PathTable& paths = PathTable::global());
+  // flows are numbered 0..num_flows-1 (e.g. flow table slots),
+  // flow_paths[f] is f's path id in our path table, -1 if there's no flow f.
+  // sets rates[f] for every flow f, in Gb/s like the link capacities.
+  // picks the cheapest weight policy that fits flow_weights,
+  // all weights 1 (the common case) runs the unweighted solver
+  void do_waterfilling(const int* flow_paths, const double* flow_weights,
+		       int num_flows, double* rates);
+  // same with float32 weights and rates (compact flow tables),
+  // solved in double and rounded on the way out
+  void do_waterfilling(const int* flow_paths, const float* flow_weights,
+		       int num_flows, float* rates);
+  // same for flows keyed by flow id
+  void do_waterfilling(const std::map<int, int >& flow_to_path,
+		       const std::map<int, double >& flow_to_weight,
+                            std::map<int, double >& rates);
+  // same with explicit link lists, interns them first
   void do_waterfilling(const std::map<int, std::vector< link_t > >& flow_to_path, 
 		       const std::map<int, double >& flow_to_weight,
                             std::map<int, double >& rates);
+  void set_aggregation(bool aggregate) { aggregate_flows = aggregate; }
+  void set_incremental(bool on) { incremental = on; }
+  void set_solver_mode(SolverMode mode) { solver_mode = mode; }
+  void set_tree_check(bool on) { check_tree = on; }
+  // solves the tree solver ran, the rest went to the general one
+  long get_num_tree_solves() const { return num_tree_solves; }
+  void set_link_pruning(bool on) { prune_links = on; }
+  // links used by some flow and how many of them were pruned, summed
+  // over the general solver's solves
+  long get_num_links_solved() const { return num_links_solved; }
+  long get_num_links_pruned() const { return num_links_pruned; }
+  // start each solve from the last one's levels: flows below the first
+  // level the changes can reach keep their rates and only the rest is
+  // solved, incrementally (see WaterfillingSolver::do_warm_waterfilling).
+  // Solves where that keeps no flow, or most flows changed, are solved
+  // from scratch, also incrementally. Flows are matched by number, rates
+  // can differ from the plain solver's in the last bits
+  void set_warm_start(bool on) { warm_start = on; }
+  long get_num_warm_hits() const { return num_warm_hits; }
+  long get_num_warm_misses() const { return num_warm_misses; }
+  long get_num_warm_flows() const { return num_warm_flows; }
+  long get_num_warm_flows_kept() const { return num_warm_flows_kept; }
+  // remember up to max_bytes of solved allocations by their multiset of
+  // (path, weight) classes and hand back the rates when one comes back
+  // (rate_memo.h), 0 turns it off. Only for aggregated solves, warm
+  // starts go around it
+  void set_memo(size_t max_bytes) { memo.reset(max_bytes ? new RateMemo(max_bytes) : nullptr); }
+  const RateMemo* get_memo() const { return memo.get(); }
+  size_t get_warm_capacity() const {
+    return warm_path.capacity() + warm_weight.capacity() + warm_level.capacity();
+  }
+  // flows and solver entities summed over all solves so far, memo and
+  // warm start hits included
+  long get_num_flows_solved() const { return num_flows_solved; }
+  long get_num_entities_solved() const { return num_entities_solved; }
+  // bytes of solver scratch and how often it had to grow
+  size_t get_arena_capacity() const { return arena.capacity(); }
+  size_t get_arena_mallocs() const { return arena.get_num_mallocs(); }
+  size_t get_path_links_capacity() const { return path_links.capacity(); }
+  // bytes kept between solves: the arena, warm start levels and path
+  // link ids (not the memo, see RateMemo::get_bytes())
+  size_t scratch_bytes() const {
+    return arena.capacity() + path_links.capacity() * sizeof(int)
+      + warm_path.capacity() * sizeof(int)
+      + (warm_weight.capacity() + warm_level.capacity()) * sizeof(double);
+  }
 };
+
+#endif
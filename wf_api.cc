@@ -0,0 +1,166 @@
+#include "wf_api.h"
+#include "waterfilling_engine.h"
+#include <memory>
+#include <vector>
+#include <map>
+
+struct wf_engine {
+  std::unique_ptr<Topology> topology;
+  PathTable paths; // our own, engines don't share path ids
+  std::unique_ptr<WaterfillingEngine> engine;
+  std::vector< link_t > path_buf;
+  std::unique_ptr<RateSnapshots> snapshots; // if readers are enabled
+
+  explicit wf_engine(std::unique_ptr<Topology> t) : topology(std::move(t)) {
+    engine.reset(new WaterfillingEngine(*topology, paths));
+    engine->drain_until(0); // nothing to drain yet, just sets the clock
+  }
+
+  void update_if_needed() {
+    if (engine->rates_need_update()) engine->update_rates();
+  }
+
+  // path id of an explicit node path, -1 if a link isn't in the topology
+  int intern(const int* nodes, int num_nodes) {
+    path_buf.clear();
+    for (int i = 1; i < num_nodes; i++) {
+      link_t link = std::make_pair(nodes[i - 1], nodes[i]);
+      if (topology->link_id(link) < 0) return -1;
+      path_buf.push_back(link);
+    }
+    return paths.intern(path_buf);
+  }
+};
+
+struct wf_reader {
+  RateSnapshots* snapshots;
+  int id;
+};
+
+extern "C" {
+
+wf_engine* wf_create_from_file(const char* link_filename) {
+  return new wf_engine(Topology::load(link_filename));
+}
+
+wf_engine* wf_create(int num_links, const int* src, const int* dst, const double* capacity) {
+  std::map< link_t, double > link_capacities;
+  for (int i = 0; i < num_links; i++) {
+    link_capacities[std::make_pair(src[i], dst[i])] = capacity[i];
+  }
+  return new wf_engine(Topology::from_capacities(link_capacities));
+}
+
+void wf_destroy(wf_engine* engine) {
+  delete engine;
+}
+
+void wf_set_rate_change_callback(wf_engine* engine, wf_rate_change_fn fn, void* ctx) {
+  if (not fn) {
+    engine->engine->on_rate_change = nullptr;
+    return;
+  }
+  engine->engine->on_rate_change = [fn, ctx](int flow_id, double time, double rate) {
+    fn(ctx, flow_id, time, rate);
+  };
+}
+
+void wf_set_finish_callback(wf_engine* engine, wf_finish_fn fn, void* ctx) {
+  if (not fn) {
+    engine->engine->on_finish = nullptr;
+    return;
+  }
+  engine->engine->on_finish = [fn, ctx](const FinishedFlow& flow) {
+    fn(ctx, flow.flow_id, flow.start, flow.end, flow.size);
+  };
+}
+
+int wf_add_flow(wf_engine* engine, int flow_id, const int* nodes, int num_nodes,
+		double bytes, double weight) {
+  if (flow_id < 0 or bytes <= 0 or weight <= 0 or num_nodes < 2) return -1;
+  if (engine->engine->get_flows().find(flow_id) >= 0) return -1;
+  int path;
+  if (num_nodes == 2) {
+    path = engine->engine->route(nodes[0], nodes[1], flow_id);
+  } else {
+    path = engine->intern(nodes, num_nodes);
+  }
+  if (path < 0) return -1;
+  engine->engine->add_flow(flow_id, path, bytes, weight);
+  return 0;
+}
+
+int wf_remove_flow(wf_engine* engine, int flow_id) {
+  return engine->engine->remove_flow(flow_id) ? 0 : -1;
+}
+
+int wf_advance(wf_engine* engine, double time) {
+  return engine->engine->advance(time) == DrainStatus::ok ? 0 : -1;
+}
+
+double wf_now(const wf_engine* engine) {
+  return engine->engine->get_time();
+}
+
+double wf_rate(wf_engine* engine, int flow_id) {
+  engine->update_if_needed();
+  return engine->engine->get_rate(flow_id);
+}
+
+double wf_next_finish(wf_engine* engine) {
+  engine->update_if_needed();
+  return engine->engine->get_next_finish();
+}
+
+int wf_num_active_flows(const wf_engine* engine) {
+  return engine->engine->get_flows().num_active();
+}
+
+double wf_what_if_rate(wf_engine* engine, const int* nodes, int num_nodes, double weight) {
+  if (weight <= 0 or num_nodes < 2) return -1;
+  engine->update_if_needed();
+  if (num_nodes == 2) {
+    if (nodes[0] < 0 or nodes[0] >= engine->topology->num_nodes()) return -1;
+    if (nodes[1] < 0 or nodes[1] >= engine->topology->num_nodes()) return -1;
+    const std::vector< int >& routes = engine->engine->get_routes(nodes[0], nodes[1]);
+    if (routes.size() == 0) return -1;
+    double rate;
+    engine->engine->what_if().best_path(routes.data(), routes.size(), weight, &rate);
+    return rate;
+  }
+  int path = engine->intern(nodes, num_nodes);
+  if (path < 0) return -1;
+  return engine->engine->what_if().rate_if_added(path, weight);
+}
+
+void wf_enable_snapshots(wf_engine* engine, int max_readers) {
+  if (engine->snapshots) return;
+  engine->snapshots.reset(new RateSnapshots(max_readers));
+  engine->snapshots->publish(engine->engine->get_flows(), engine->engine->get_time());
+  engine->engine->set_snapshots(engine->snapshots.get());
+}
+
+wf_reader* wf_reader_open(wf_engine* engine) {
+  if (not engine->snapshots) return nullptr;
+  int id = engine->snapshots->register_reader();
+  if (id < 0) return nullptr;
+  wf_reader* reader = new wf_reader;
+  reader->snapshots = engine->snapshots.get();
+  reader->id = id;
+  return reader;
+}
+
+void wf_reader_close(wf_reader* reader) {
+  reader->snapshots->unregister_reader(reader->id);
+  delete reader;
+}
+
+long wf_reader_rates(wf_reader* reader, const int* flow_ids, int num_flows,
+		     double* rates, double* time) {
+  PinnedSnapshot snapshot(*reader->snapshots, reader->id);
+  for (int i = 0; i < num_flows; i++) rates[i] = snapshot->rate(flow_ids[i]);
+  if (time) *time = snapshot->get_time();
+  return snapshot->get_version();
+}
+
+}
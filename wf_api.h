@@ -0,0 +1,83 @@
+#ifndef WF_API_H
+#define WF_API_H
+
+/* C interface to the waterfilling engine, so a packet level simulator can
+   link libwaterfilling and get ideal max-min rates in process instead of
+   going through trace files. Rates are in Gb/s like the link capacities,
+   sizes in bytes, times in seconds starting at 0. Engines are independent
+   of each other but not thread safe. Like the simulators, broken input
+   files and internal errors end the process with a message on stderr. */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct wf_engine wf_engine;
+
+/* rate of flow_id changed at time, called when rates are re-solved */
+typedef void (*wf_rate_change_fn)(void* ctx, int flow_id, double time, double rate);
+/* flow_id sent its last byte at end */
+typedef void (*wf_finish_fn)(void* ctx, int flow_id, double start, double end, double bytes);
+
+/* topology from a link file ("node1 node2 capacity" lines) or a wtopo snapshot */
+wf_engine* wf_create_from_file(const char* link_filename);
+/* num_links links src[i] -> dst[i] of capacity[i] */
+wf_engine* wf_create(int num_links, const int* src, const int* dst, const double* capacity);
+void wf_destroy(wf_engine* engine);
+
+void wf_set_rate_change_callback(wf_engine* engine, wf_rate_change_fn fn, void* ctx);
+void wf_set_finish_callback(wf_engine* engine, wf_finish_fn fn, void* ctx);
+
+/* starts a flow at the current time along nodes[0] -> .. -> nodes[num_nodes-1],
+   a flow with just src and dst is routed on the topology (ECMP by flow id).
+   weight 1 for plain max-min. 0 if added, -1 if flow_id is already active,
+   bytes or weight aren't positive, or the path isn't in the topology */
+int wf_add_flow(wf_engine* engine, int flow_id, const int* nodes, int num_nodes,
+		double bytes, double weight);
+/* stops a flow without reporting it as finished, -1 if it isn't active */
+int wf_remove_flow(wf_engine* engine, int flow_id);
+
+/* moves time forward, flows that finish on the way are reported and
+   rates re-solved after each finish. times before now are ignored.
+   0, or -1 if a flow was drained past its finish (it's stopped there) */
+int wf_advance(wf_engine* engine, double time);
+double wf_now(const wf_engine* engine);
+
+/* these re-solve first if flows were added or removed since the last solve */
+/* rate of an active flow, -1 if it isn't active */
+double wf_rate(wf_engine* engine, int flow_id);
+/* when the next active flow finishes at current rates, -1 if none will */
+double wf_next_finish(wf_engine* engine);
+
+int wf_num_active_flows(const wf_engine* engine);
+
+/* rate a new flow along nodes with weight would get right now, without
+   adding it (re-solves first if needed). with just src and dst, the best
+   of the equal cost paths. -1 if the path isn't in the topology */
+double wf_what_if_rate(wf_engine* engine, const int* nodes, int num_nodes, double weight);
+
+/* Reading rates from other threads. Once snapshots are enabled every
+   solve publishes its rates as a snapshot that is never changed after,
+   reader threads each open a reader and read the latest snapshot without
+   locks or waiting on the engine, so they never see a half done solve.
+   The engine calls above stay on one thread. Enable snapshots before
+   opening readers, close every reader before wf_destroy. */
+typedef struct wf_reader wf_reader;
+
+/* up to max_readers readers at once, publishes the last solve right away */
+void wf_enable_snapshots(wf_engine* engine, int max_readers);
+/* NULL if snapshots aren't enabled or max_readers are open. a reader is
+   used by one thread at a time */
+wf_reader* wf_reader_open(wf_engine* engine);
+void wf_reader_close(wf_reader* reader);
+/* rates[i] of flow_ids[i] (-1 if it wasn't active), all from the same
+   snapshot. returns the snapshot's version, which goes up with every
+   solve, and puts its time in *time if time isn't NULL */
+long wf_reader_rates(wf_reader* reader, const int* flow_ids, int num_flows,
+		     double* rates, double* time);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,301 @@
+#include "wf_daemon.h"
+#include <iostream>
+#include <algorithm>
+#include <limits>
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+namespace {
+
+volatile sig_atomic_t stop_requested = 0;
+
+void request_stop(int) { stop_requested = 1; }
+
+void set_nonblocking(int fd) {
+  int flags = fcntl(fd, F_GETFL, 0);
+  if (flags < 0 or fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+    std::cerr << "couldn't make fd " << fd << " non-blocking: "
+	      << strerror(errno) << std::endl;
+    exit(1);
+  }
+}
+
+double us_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+// q-th quantile of values, sorts them
+double quantile(std::vector< double >& values, double q) {
+  if (values.size() == 0) return 0;
+  std::sort(values.begin(), values.end());
+  size_t i = std::min(values.size() - 1, (size_t) (q * values.size()));
+  return values[i];
+}
+
+}
+
+AllocatorDaemon::AllocatorDaemon(const std::string& link_filename,
+				 const std::string& socket_path,
+				 int batch_us)
+  : socket_path(socket_path), batch_us(batch_us) {
+  topology = Topology::load(link_filename);
+  engine.reset(new WaterfillingEngine(*topology));
+  engine->set_incremental_solve(true);
+  engine->drain_until(0); // time never moves, flows run until agents end them
+  engine->on_rate_change = [this](int flow_id, double, double rate) {
+    int slot = engine->get_flows().find(flow_id);
+    auto it = clients.find(owner[slot]);
+    if (it != clients.end()) queue_rate(it->second, flow_id, rate);
+  };
+
+  sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (socket_path.size() >= sizeof(addr.sun_path)) {
+    std::cerr << "socket path too long " << socket_path << std::endl;
+    exit(1);
+  }
+  strcpy(addr.sun_path, socket_path.c_str());
+  unlink(socket_path.c_str());
+
+  listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listen_fd < 0
+      or bind(listen_fd, (sockaddr*) &addr, sizeof(addr)) < 0
+      or listen(listen_fd, 64) < 0) {
+    std::cerr << "couldn't listen on " << socket_path << ": "
+	      << strerror(errno) << std::endl;
+    exit(1);
+  }
+  set_nonblocking(listen_fd);
+  signal(SIGPIPE, SIG_IGN);
+}
+
+AllocatorDaemon::~AllocatorDaemon() {
+  for (auto& fc : clients) close(fc.first);
+  if (listen_fd >= 0) {
+    close(listen_fd);
+    unlink(socket_path.c_str());
+  }
+}
+
+void AllocatorDaemon::accept_clients() {
+  while (true) {
+    int fd = accept(listen_fd, nullptr, nullptr);
+    if (fd < 0) {
+      if (errno != EAGAIN and errno != EWOULDBLOCK and errno != EINTR) {
+	std::cerr << "accept failed: " << strerror(errno) << std::endl;
+      }
+      return;
+    }
+    set_nonblocking(fd);
+    clients[fd].fd = fd;
+  }
+}
+
+bool AllocatorDaemon::read_client(Client& client) {
+  char buf[1 << 16];
+  while (true) {
+    ssize_t n = recv(client.fd, buf, sizeof(buf), 0);
+    if (n == 0) return false;
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return errno == EAGAIN or errno == EWOULDBLOCK;
+    }
+    client.in.insert(client.in.end(), buf, buf + n);
+    size_t used = 0;
+    while (client.in.size() - used >= sizeof(wfp_update)) {
+      wfp_update update;
+      memcpy(&update, client.in.data() + used, sizeof(update));
+      used += sizeof(update);
+      if (update.type != WFP_START and update.type != WFP_END) {
+	std::cerr << "agent on fd " << client.fd << " sent update type "
+		  << update.type << ", dropping it" << std::endl;
+	return false;
+      }
+      apply(update, client);
+    }
+    client.in.erase(client.in.begin(), client.in.begin() + used);
+  }
+}
+
+void AllocatorDaemon::apply(const wfp_update& update, Client& client) {
+  if (not batch_pending) {
+    batch_pending = true;
+    batch_start = clock::now();
+  }
+  num_updates++;
+
+  if (update.type == WFP_END) {
+    int slot = engine->get_flows().find(update.flow_id);
+    if (slot >= 0 and owner[slot] == client.fd) engine->remove_flow(update.flow_id);
+    return;
+  }
+
+  int path = -1;
+  if (update.flow_id >= 0 and update.weight > 0
+      and update.src >= 0 and update.src < topology->num_nodes()
+      and update.dst >= 0 and update.dst < topology->num_nodes()
+      and engine->get_flows().find(update.flow_id) < 0) {
+    path = engine->route(update.src, update.dst, update.flow_id);
+  }
+  if (path < 0) {
+    queue_rate(client, update.flow_id, -1);
+    return;
+  }
+  int slot = engine->add_flow(update.flow_id, path,
+			      std::numeric_limits<double>::infinity(), update.weight);
+  if ((int) owner.size() <= slot) owner.resize(engine->get_flows().num_slots(), -1);
+  owner[slot] = client.fd;
+}
+
+void AllocatorDaemon::queue_rate(Client& client, int flow_id, double rate) {
+  wfp_rate r;
+  r.flow_id = flow_id;
+  r.rate = rate;
+  const char* p = (const char*) &r;
+  client.out.insert(client.out.end(), p, p + sizeof(r));
+  num_rates_sent++;
+}
+
+bool AllocatorDaemon::flush(Client& client) {
+  while (client.out_sent < client.out.size()) {
+    ssize_t n = send(client.fd, client.out.data() + client.out_sent,
+		     client.out.size() - client.out_sent, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return errno == EAGAIN or errno == EWOULDBLOCK;
+    }
+    client.out_sent += n;
+  }
+  client.out.clear();
+  client.out_sent = 0;
+  return true;
+}
+
+void AllocatorDaemon::drop_client(int fd) {
+  // the agent's flows end with it
+  const FlowTable& flows = engine->get_flows();
+  for (int slot = 0; slot < flows.num_slots(); slot++) {
+    if (flows.in_use(slot) and owner[slot] == fd) {
+      engine->remove_flow(flows.flow_id[slot]);
+      if (not batch_pending) {
+	batch_pending = true;
+	batch_start = clock::now();
+      }
+    }
+  }
+  close(fd);
+  clients.erase(fd);
+  if (clients.size() == 0) report();
+}
+
+void AllocatorDaemon::solve_batch() {
+  clock::time_point solve_start = clock::now();
+  if (engine->rates_need_update()) engine->update_rates();
+  solve_us.push_back(us_since(solve_start));
+  num_batches++;
+  batch_pending = false;
+}
+
+void AllocatorDaemon::report() {
+  if (num_updates == 0) return;
+  std::cout << "batches " << num_batches
+	    << " updates " << num_updates
+	    << " rates sent " << num_rates_sent
+	    << " active flows " << engine->get_flows().num_active()
+	    << " peak " << engine->get_peak_active_flows() << "\n"
+	    << "solve us p50 " << quantile(solve_us, 0.5)
+	    << " p99 " << quantile(solve_us, 0.99)
+	    << " max " << quantile(solve_us, 1) << "\n"
+	    << "first update to rates us p50 " << quantile(update_us, 0.5)
+	    << " p99 " << quantile(update_us, 0.99)
+	    << " max " << quantile(update_us, 1) << std::endl;
+  num_updates = num_batches = num_rates_sent = 0;
+  solve_us.clear();
+  update_us.clear();
+}
+
+void AllocatorDaemon::run() {
+  // SIGINT and SIGTERM only get through while we wait in ppoll
+  sigset_t stop_signals, wait_mask;
+  sigemptyset(&stop_signals);
+  sigaddset(&stop_signals, SIGINT);
+  sigaddset(&stop_signals, SIGTERM);
+  sigprocmask(SIG_BLOCK, &stop_signals, &wait_mask);
+  sigdelset(&wait_mask, SIGINT);
+  sigdelset(&wait_mask, SIGTERM);
+  signal(SIGINT, request_stop);
+  signal(SIGTERM, request_stop);
+
+  std::vector< pollfd > fds;
+  std::vector< int > to_drop;
+  while (not stop_requested) {
+    fds.clear();
+    fds.push_back(pollfd{listen_fd, POLLIN, 0});
+    for (auto& fc : clients) {
+      short events = POLLIN;
+      if (fc.second.out.size() > fc.second.out_sent) events |= POLLOUT;
+      fds.push_back(pollfd{fc.first, events, 0});
+    }
+
+    // wait for more updates only until the batch window closes
+    timespec wait;
+    timespec* timeout = nullptr;
+    if (batch_pending) {
+      double left_us = std::max(0.0, batch_us - us_since(batch_start));
+      wait.tv_sec = (time_t) (left_us / 1e6);
+      wait.tv_nsec = (long) ((left_us - wait.tv_sec * 1e6) * 1e3);
+      timeout = &wait;
+    }
+    int ready = ppoll(fds.data(), fds.size(), timeout, &wait_mask);
+    if (ready < 0) {
+      if (errno == EINTR) continue;
+      std::cerr << "poll failed: " << strerror(errno) << std::endl;
+      exit(1);
+    }
+
+    to_drop.clear();
+    for (size_t i = 1; i < fds.size(); i++) {
+      if (fds[i].revents == 0) continue;
+      Client& client = clients[fds[i].fd];
+      bool ok = true;
+      if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) ok = read_client(client);
+      if (ok and (fds[i].revents & POLLOUT)) ok = flush(client);
+      if (not ok) to_drop.push_back(client.fd);
+    }
+    for (int fd : to_drop) drop_client(fd);
+    if (fds[0].revents & POLLIN) accept_clients();
+
+    if (batch_pending and us_since(batch_start) >= batch_us) {
+      solve_batch();
+      to_drop.clear();
+      for (auto& fc : clients) {
+	if (not flush(fc.second)) to_drop.push_back(fc.first);
+      }
+      // the rates are on their way to the agents now
+      update_us.push_back(us_since(batch_start));
+      for (int fd : to_drop) drop_client(fd);
+    }
+  }
+  report();
+}
+
+int main(int argc, char** argv) {
+  if (argc != 3 and argc != 4) {
+    std::cerr << "Expected 2 or 3 arguments to binary- link file, socket path, [batch window in us, default 50]\n";
+    exit(1);
+  }
+  int batch_us = argc == 4 ? atoi(argv[3]) : 50;
+  AllocatorDaemon daemon(argv[1], argv[2], batch_us);
+  std::cout << "listening on " << argv[2] << ", batching updates for "
+	    << batch_us << " us" << std::endl;
+  daemon.run();
+  return 0;
+}
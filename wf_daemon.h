@@ -0,0 +1,71 @@
+#ifndef WF_DAEMON_H
+#define WF_DAEMON_H
+
+#include "waterfilling_engine.h"
+#include "wf_protocol.h"
+#include <chrono>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Central rate allocator for a controller: agents connect on a Unix
+// domain socket and report flow starts and ends (wf_protocol.h), one
+// persistent engine keeps the active flows and their max-min rates.
+// Updates that come in within batch_us of the first one are applied
+// together and solved once, then each agent is sent the rates of its
+// flows that changed. Flows of an agent that disconnects are ended.
+class AllocatorDaemon {
+ protected:
+  typedef std::chrono::steady_clock clock;
+
+  struct Client {
+    int fd;
+    std::vector< char > in;  // partial record left from the last read
+    std::vector< char > out; // rates not sent yet
+    size_t out_sent = 0;
+  };
+
+  std::string socket_path;
+  int batch_us;
+  int listen_fd = -1;
+
+  std::unique_ptr<Topology> topology;
+  std::unique_ptr<WaterfillingEngine> engine;
+  std::map< int, Client > clients; // by fd
+  std::vector< int > owner; // fd of the agent owning each flow table slot
+
+  // batch being collected, since the first update in it
+  bool batch_pending = false;
+  clock::time_point batch_start;
+
+  // since the last report
+  long num_updates = 0;
+  long num_batches = 0;
+  long num_rates_sent = 0;
+  std::vector< double > solve_us;  // one solve per batch
+  std::vector< double > update_us; // first update in batch to rates written
+
+  void accept_clients();
+  // false if the agent hung up or sent something broken
+  bool read_client(Client& client);
+  void apply(const wfp_update& update, Client& client);
+  void queue_rate(Client& client, int flow_id, double rate);
+  // false if the socket broke
+  bool flush(Client& client);
+  void drop_client(int fd);
+  void solve_batch();
+  void report();
+
+ public:
+  // listens on socket_path (replacing a stale socket file)
+  AllocatorDaemon(const std::string& link_filename,
+		  const std::string& socket_path,
+		  int batch_us);
+  ~AllocatorDaemon();
+  // serves agents until SIGINT or SIGTERM, prints stats whenever
+  // the last agent leaves and when it stops
+  void run();
+};
+
+#endif
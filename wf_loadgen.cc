@@ -0,0 +1,189 @@
+#include "wf_protocol.h"
+#include <iostream>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// Load generator for the allocator daemon (wfd): starts num_flows flows
+// between random hosts, then keeps replacing a random active flow with a
+// new one, num_updates times, with up to in_flight replacements waiting
+// for their rate at once. Reports how long a start takes to come back
+// with the new flow's rate.
+class LoadGenerator {
+ protected:
+  typedef std::chrono::steady_clock clock;
+
+  int fd = -1;
+  int num_hosts;
+  std::mt19937 rng;
+
+  std::vector< int > active; // flows that have their rate
+  std::map< int, clock::time_point > waiting; // started flow -> when
+  int next_flow = 0;
+  long num_refused = 0;
+  long num_rates = 0;
+  std::vector< double > latency_us;
+  bool measuring = false;
+
+  std::vector< char > in;
+  std::vector< char > out;
+
+  void add_update(int type, int flow) {
+    wfp_update update;
+    memset(&update, 0, sizeof(update));
+    update.type = type;
+    update.flow_id = flow;
+    if (type == WFP_START) {
+      update.src = rng() % num_hosts;
+      update.dst = rng() % (num_hosts - 1);
+      if (update.dst >= update.src) update.dst++;
+      update.weight = 1;
+    }
+    const char* p = (const char*) &update;
+    out.insert(out.end(), p, p + sizeof(update));
+  }
+
+  void start_flow() {
+    int flow = next_flow++;
+    add_update(WFP_START, flow);
+    waiting[flow] = clock::now();
+  }
+
+  // ends a random flow that has its rate and starts a new one
+  void replace_flow() {
+    if (active.size() > 0) {
+      size_t i = rng() % active.size();
+      add_update(WFP_END, active[i]);
+      active[i] = active.back();
+      active.pop_back();
+    }
+    start_flow();
+  }
+
+  void send_out() {
+    size_t sent = 0;
+    while (sent < out.size()) {
+      ssize_t n = send(fd, out.data() + sent, out.size() - sent, 0);
+      if (n < 0) {
+	if (errno == EINTR) continue;
+	std::cerr << "send failed: " << strerror(errno) << std::endl;
+	exit(1);
+      }
+      sent += n;
+    }
+    out.clear();
+  }
+
+  // reads rates until one of the waiting flows gets its rate,
+  // returns how many did
+  int receive() {
+    char buf[1 << 16];
+    int num_done = 0;
+    while (num_done == 0) {
+      ssize_t n = recv(fd, buf, sizeof(buf), 0);
+      if (n < 0 and errno == EINTR) continue;
+      if (n <= 0) {
+	std::cerr << "daemon hung up" << std::endl;
+	exit(1);
+      }
+      clock::time_point now = clock::now();
+      in.insert(in.end(), buf, buf + n);
+      size_t used = 0;
+      for (; in.size() - used >= sizeof(wfp_rate); used += sizeof(wfp_rate)) {
+	wfp_rate r;
+	memcpy(&r, in.data() + used, sizeof(r));
+	num_rates++;
+	auto it = waiting.find(r.flow_id);
+	if (it == waiting.end()) continue;
+	if (measuring) {
+	  latency_us.push_back(std::chrono::duration<double, std::micro>(now - it->second).count());
+	}
+	if (r.rate < 0) num_refused++;
+	else active.push_back(r.flow_id);
+	waiting.erase(it);
+	num_done++;
+      }
+      in.erase(in.begin(), in.begin() + used);
+    }
+    return num_done;
+  }
+
+ public:
+  LoadGenerator(const std::string& socket_path, int num_hosts, unsigned seed)
+    : num_hosts(num_hosts), rng(seed) {
+    if (num_hosts < 2) {
+      std::cerr << "need at least 2 hosts" << std::endl;
+      exit(1);
+    }
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(addr.sun_path)) {
+      std::cerr << "socket path too long " << socket_path << std::endl;
+      exit(1);
+    }
+    strcpy(addr.sun_path, socket_path.c_str());
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 or connect(fd, (sockaddr*) &addr, sizeof(addr)) < 0) {
+      std::cerr << "couldn't connect to " << socket_path << ": "
+		<< strerror(errno) << std::endl;
+      exit(1);
+    }
+  }
+
+  ~LoadGenerator() {
+    if (fd >= 0) close(fd);
+  }
+
+  void run(int num_flows, int num_updates, int in_flight) {
+    // all flows at once, the daemon solves them in a few batches
+    for (int i = 0; i < num_flows; i++) start_flow();
+    send_out();
+    while (waiting.size() > 0) receive();
+    std::cout << "started " << active.size() << " flows, "
+	      << num_refused << " refused" << std::endl;
+
+    measuring = true;
+    num_rates = 0;
+    clock::time_point start = clock::now();
+    int num_sent = 0;
+    while (num_sent < num_updates or waiting.size() > 0) {
+      while (num_sent < num_updates and (int) waiting.size() < in_flight) {
+	replace_flow();
+	num_sent++;
+      }
+      send_out();
+      receive();
+    }
+    double secs = std::chrono::duration<double>(clock::now() - start).count();
+
+    std::sort(latency_us.begin(), latency_us.end());
+    size_t n = latency_us.size();
+    if (n == 0) return;
+    std::cout << num_updates << " updates in " << secs << " s, "
+	      << num_updates / secs << " per s, "
+	      << (double) num_rates / num_updates << " rates back per update\n"
+	      << "start to rate us p50 " << latency_us[n / 2]
+	      << " p99 " << latency_us[std::min(n - 1, n * 99 / 100)]
+	      << " max " << latency_us[n - 1] << std::endl;
+  }
+};
+
+int main(int argc, char** argv) {
+  if (argc < 5 or argc > 7) {
+    std::cerr << "Expected 4 to 6 arguments to binary- socket path, num hosts, num active flows, num updates, [updates in flight, default 1], [seed]\n";
+    exit(1);
+  }
+  int in_flight = argc > 5 ? atoi(argv[5]) : 1;
+  unsigned seed = argc > 6 ? atoi(argv[6]) : 1;
+  LoadGenerator gen(argv[1], atoi(argv[2]), seed);
+  gen.run(atoi(argv[3]), atoi(argv[4]), std::max(1, in_flight));
+}
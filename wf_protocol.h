@@ -0,0 +1,31 @@
+#ifndef WF_PROTOCOL_H
+#define WF_PROTOCOL_H
+
+/* Wire format between agents and the allocator daemon (wfd) on its Unix
+   domain socket. Fixed size records in host byte order, both ends are on
+   the same machine. Agents send wfp_update records, the daemon answers
+   with wfp_rate records: after every solve one for each of the agent's
+   flows whose rate changed, including flows it just started. Flow ids
+   are global to the daemon, agents have to pick ids that don't clash. */
+
+#include <stdint.h>
+
+enum {
+  WFP_START = 1, /* flow_id starts from src to dst, routed by the daemon */
+  WFP_END = 2    /* flow_id is done, src, dst and weight are ignored */
+};
+
+struct wfp_update {
+  int32_t type;
+  int32_t flow_id;
+  int32_t src;
+  int32_t dst;
+  float weight; /* 1 for plain max-min */
+};
+
+struct wfp_rate {
+  int32_t flow_id;
+  float rate; /* Gb/s, -1 if a start was refused */
+};
+
+#endif
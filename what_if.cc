@@ -0,0 +1,263 @@
+#include "what_if.h"
+#include <iostream>
+#include <algorithm>
+#include <limits>
+#include <cstdlib>
+
+WhatIf::WhatIf(const Topology& topology, const PathTable& paths)
+  : topology(topology), paths(paths) {}
+
+void WhatIf::load(const FlowTable& flows) {
+  loaded_flows = &flows;
+  path_links.update(paths, topology);
+  int num_slots = flows.num_slots();
+  slot_path.assign(num_slots, -1);
+  slot_level.assign(num_slots, 0);
+  slot_weight.assign(num_slots, 0);
+  link_begin.assign(topology.num_links() + 1, 0);
+  for (int slot = 0; slot < num_slots; slot++) {
+    if (not flows.in_use(slot)) continue;
+    if (flows.rate[slot] <= 0) {
+      std::cerr << "what-if needs solved rates, flow " << flows.flow_id[slot]
+		<< " has rate " << flows.rate[slot] << std::endl;
+      exit(1);
+    }
+    int path = flows.path[slot];
+    slot_path[slot] = path;
+    slot_weight[slot] = flows.weight[slot];
+    slot_level[slot] = flows.rate[slot] / flows.weight[slot];
+    for (const int* l = path_links.begin(path); l != path_links.end(path); l++) {
+      link_begin[*l + 1]++;
+    }
+  }
+  for (int l = 0; l < topology.num_links(); l++) link_begin[l + 1] += link_begin[l];
+
+  // each link's flows by level
+  entries.resize(link_begin.back());
+  next_entry.assign(link_begin.begin(), link_begin.end() - 1);
+  for (int slot = 0; slot < num_slots; slot++) {
+    if (slot_path[slot] < 0) continue;
+    int path = slot_path[slot];
+    for (const int* l = path_links.begin(path); l != path_links.end(path); l++) {
+      entries[next_entry[*l]++] = std::make_pair(slot_level[slot], slot);
+    }
+  }
+  before_sum.resize(entries.size());
+  before_count.resize(entries.size());
+  link_sum.assign(topology.num_links(), 0);
+  link_count.assign(topology.num_links(), 0);
+  for (int l = 0; l < topology.num_links(); l++) {
+    std::sort(entries.begin() + link_begin[l], entries.begin() + link_begin[l + 1]);
+    double sum = 0, count = 0;
+    for (int i = link_begin[l]; i < link_begin[l + 1]; i++) {
+      before_sum[i] = sum;
+      before_count[i] = count;
+      double weight = slot_weight[entries[i].second];
+      sum += entries[i].first * weight;
+      count += weight;
+    }
+    link_sum[l] = sum;
+    link_count[l] = count;
+  }
+
+  slot_stamp.assign(num_slots, 0);
+  slot_wanted.assign(num_slots, 0);
+  slot_new_rate.assign(num_slots, 0);
+  query = 0;
+}
+
+int WhatIf::first_at_or_above(int link, double level) const {
+  auto first = entries.begin() + link_begin[link];
+  auto last = entries.begin() + link_begin[link + 1];
+  return std::lower_bound(first, last, std::make_pair(level, -1)) - entries.begin();
+}
+
+double WhatIf::fill_level(int link, double extra) const {
+  // below the i-th flow's level the link carries before_sum[i] from
+  // saturated flows plus level times the weight still unsat, which only
+  // grows with the level. find the first flow whose level is past the
+  // fill level, the fill level is in the stretch before it
+  double cap = topology.capacity(link);
+  int lo = link_begin[link], hi = link_begin[link + 1];
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    double unsat = link_count[link] - before_count[mid] + extra;
+    if (cap - before_sum[mid] - unsat * entries[mid].first <= 0) hi = mid;
+    else lo = mid + 1;
+  }
+  double sum = lo < link_begin[link + 1] ? before_sum[lo] : link_sum[link];
+  double count = lo < link_begin[link + 1] ? link_count[link] - before_count[lo] : 0;
+  return std::max(0.0, (cap - sum) / (count + extra));
+}
+
+double WhatIf::rate_if_added(int path, double weight) {
+  path_links.update(paths, topology);
+  double level = std::numeric_limits<double>::infinity();
+  for (const int* l = path_links.begin(path); l != path_links.end(path); l++) {
+    level = std::min(level, fill_level(*l, weight));
+  }
+  return level * weight;
+}
+
+int WhatIf::best_path(const int* candidates, int num_candidates, double weight, double* rate) {
+  int best = -1;
+  double best_rate = -1;
+  for (int i = 0; i < num_candidates; i++) {
+    double r = rate_if_added(candidates[i], weight);
+    if (best < 0 or r > best_rate) {
+      best = candidates[i];
+      best_rate = r;
+    }
+  }
+  if (rate) *rate = best_rate;
+  return best;
+}
+
+// one flow is done at level, its weight moves from unsat to saturated
+// on every link it uses
+void WhatIf::take_out(const int* first, const int* last, double level, double weight) {
+  for (const int* l = first; l != last; l++) {
+    sat_sum[*l] += level * weight;
+    // exactly 0 once the last one is gone, double counts may not cancel
+    if (--unsat_flows[*l] == 0) unsat_count[*l] = 0;
+    else unsat_count[*l] -= weight;
+  }
+}
+
+void WhatIf::evaluate(const int* add_paths, const double* add_weights, int num_adds,
+		      const int* remove_flows, int num_removes,
+		      const int* query_flows, int num_queries,
+		      double* add_rates, double* query_rates) {
+  path_links.update(paths, topology);
+  query++;
+
+  // nothing changes below the lowest level a link on an added path would
+  // fill up at, or a removed flow saturated at
+  double resume_level = std::numeric_limits<double>::infinity();
+  extra_count.assign(topology.num_links(), 0);
+  for (int a = 0; a < num_adds; a++) {
+    const int* path = path_links.begin(add_paths[a]);
+    for (const int* l = path; l != path_links.end(add_paths[a]); l++) {
+      extra_count[*l] += add_weights[a];
+    }
+  }
+  for (int l = 0; l < topology.num_links(); l++) {
+    if (extra_count[l] > 0) resume_level = std::min(resume_level, fill_level(l, extra_count[l]));
+  }
+  remove_slots.clear();
+  for (int i = 0; i < num_removes; i++) {
+    int slot = loaded_flows->find(remove_flows[i]);
+    if (slot < 0 or slot_stamp[slot] == query) continue;
+    slot_stamp[slot] = query;
+    remove_slots.push_back(slot);
+    resume_level = std::min(resume_level, slot_level[slot]);
+  }
+
+  // flows that saturated together can have levels a rounding error
+  // apart, resume a little lower so they're all still unsat. resuming
+  // below the first change is always right, it just takes more rounds
+  resume_level *= 1 - 1e-9;
+
+  // the solver's state at resume_level: flows below it saturated, the
+  // rest unsat at that level, then the changes on top
+  sat_sum.resize(topology.num_links());
+  unsat_count.resize(topology.num_links());
+  unsat_flows.resize(topology.num_links());
+  first_unsat.resize(topology.num_links());
+  for (int l = 0; l < topology.num_links(); l++) {
+    int first = first_at_or_above(l, resume_level);
+    first_unsat[l] = first;
+    bool all_sat = first == link_begin[l + 1];
+    sat_sum[l] = all_sat ? link_sum[l] : before_sum[first];
+    unsat_count[l] = all_sat ? 0 : link_count[l] - before_count[first];
+    unsat_flows[l] = link_begin[l + 1] - first;
+  }
+  for (int slot : remove_slots) {
+    const int* path = path_links.begin(slot_path[slot]);
+    for (const int* l = path; l != path_links.end(slot_path[slot]); l++) {
+      if (--unsat_flows[*l] == 0) unsat_count[*l] = 0;
+      else unsat_count[*l] -= slot_weight[slot];
+    }
+  }
+  for (int a = 0; a < num_adds; a++) {
+    for (const int* l = path_links.begin(add_paths[a]); l != path_links.end(add_paths[a]); l++) {
+      unsat_count[*l] += add_weights[a];
+      unsat_flows[*l]++;
+    }
+  }
+
+  // run until every flow we're asked about has its rate
+  int remaining = num_adds;
+  add_done.assign(num_adds, false);
+  query_slots.clear();
+  for (int q = 0; q < num_queries; q++) {
+    int slot = loaded_flows->find(query_flows[q]);
+    query_slots.push_back(slot);
+    if (slot < 0 or slot_stamp[slot] == query or slot_wanted[slot] == query) continue;
+    if (slot_level[slot] >= resume_level) {
+      slot_wanted[slot] = query;
+      remaining++;
+    }
+  }
+  unsat_links.clear();
+  for (int l = 0; l < topology.num_links(); l++) {
+    if (unsat_flows[l] > 0) unsat_links.push_back(l);
+  }
+
+  double level = resume_level;
+  while (remaining > 0) {
+    int min_link = -1;
+    int min_pos = -1;
+    double min_fair_share = 0;
+    size_t num_kept = 0;
+    for (size_t u = 0; u < unsat_links.size(); u++) {
+      int link = unsat_links[u];
+      if (unsat_flows[link] == 0) continue;
+      unsat_links[num_kept] = link;
+      double fair_share = (topology.capacity(link) - sat_sum[link]
+			   - level * unsat_count[link]) / unsat_count[link];
+      if (min_link < 0 or fair_share < min_fair_share) {
+	min_link = link;
+	min_pos = num_kept;
+	min_fair_share = fair_share;
+      }
+      num_kept++;
+    }
+    unsat_links.resize(num_kept);
+    if (min_link < 0) {
+      std::cerr << "what-if ran out of unsat links with "
+		<< remaining << " flows left\n";
+      exit(1);
+    }
+    level += std::max(0.0, min_fair_share);
+
+    for (int i = first_unsat[min_link]; i < link_begin[min_link + 1]; i++) {
+      int slot = entries[i].second;
+      if (slot_stamp[slot] == query) continue;
+      slot_stamp[slot] = query;
+      slot_new_rate[slot] = level * slot_weight[slot];
+      if (slot_wanted[slot] == query) remaining--;
+      take_out(path_links.begin(slot_path[slot]), path_links.end(slot_path[slot]),
+	       level, slot_weight[slot]);
+    }
+    for (int a = 0; a < num_adds; a++) {
+      if (add_done[a]) continue;
+      const int* first = path_links.begin(add_paths[a]);
+      const int* last = path_links.end(add_paths[a]);
+      if (std::find(first, last, min_link) == last) continue;
+      add_done[a] = true;
+      add_rates[a] = level * add_weights[a];
+      remaining--;
+      take_out(first, last, level, add_weights[a]);
+    }
+    unsat_links.erase(unsat_links.begin() + min_pos);
+  }
+
+  for (int q = 0; q < num_queries; q++) {
+    int slot = query_slots[q];
+    if (slot < 0) query_rates[q] = -1;
+    else if (slot_wanted[slot] == query) query_rates[q] = slot_new_rate[slot];
+    else if (slot_stamp[slot] == query) query_rates[q] = -1; // removed
+    else query_rates[q] = slot_level[slot] * slot_weight[slot];
+  }
+}
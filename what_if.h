@@ -0,0 +1,87 @@
+#ifndef WHAT_IF_H
+#define WHAT_IF_H
+
+#include "waterfilling_solver.h"
+#include "flow_table.h"
+#include <vector>
+
+// Read-only "what rate would it get" queries against one solved
+// allocation, for admission control and path placement. load() takes the
+// rates of the last solve. Each flow's level (its rate per unit weight)
+// tells how much it put on its links at any level of the waterfilling, so
+// the state the solver was in at any level can be rebuilt per link from
+// its flows sorted by level. Hypothetical changes only change the
+// waterfilling from the first level where some link would saturate
+// differently, we resume it from there instead of solving from scratch.
+// A single added flow needs no rounds at all: it saturates at the lowest
+// level where one of its links would fill up with it added, which is a
+// binary search per link on its path. Queries never change the loaded
+// allocation or the flow table.
+class WhatIf {
+ protected:
+  const Topology& topology;
+  const PathTable& paths;
+  PathLinkIds path_links;
+
+  // from load(), by flow table slot
+  const FlowTable* loaded_flows = nullptr;
+  std::vector< int > slot_path; // -1 if not in use
+  std::vector< double > slot_level;
+  std::vector< double > slot_weight;
+  // the flows on topology link l are entries link_begin[l] ..
+  // link_begin[l+1]-1, (level, slot) sorted by level. before_sum and
+  // before_count sum level * weight and weight of the entries before
+  // each one on its link
+  std::vector< int > link_begin;
+  std::vector< std::pair< double, int > > entries;
+  std::vector< int > next_entry;
+  std::vector< double > before_sum;
+  std::vector< double > before_count;
+  std::vector< double > link_sum; // over all of the link's flows
+  std::vector< double > link_count;
+
+  // scratch for evaluate(), stamps avoid clearing per query
+  int query = 0;
+  std::vector< int > slot_stamp; // query that took the slot out (saturated or removed)
+  std::vector< int > slot_wanted; // query that asked for the slot's rate
+  std::vector< double > slot_new_rate;
+  std::vector< double > sat_sum; // by topology link
+  std::vector< double > unsat_count;
+  std::vector< int > unsat_flows;
+  std::vector< int > first_unsat; // first entry of the link unsat at the resume level
+  std::vector< double > extra_count;
+  std::vector< int > unsat_links;
+  std::vector< bool > add_done;
+  std::vector< int > query_slots;
+  std::vector< int > remove_slots;
+
+  // first entry of link with level >= level
+  int first_at_or_above(int link, double level) const;
+  // level where link would fill up with extra unsat weight on it from
+  // the start, all else as loaded
+  double fill_level(int link, double extra) const;
+  void take_out(const int* first, const int* last, double level, double weight);
+
+ public:
+  // topology and paths have to outlive us
+  WhatIf(const Topology& topology, const PathTable& paths);
+  // takes the rates of the flows in use, they have to be solved.
+  // flows mustn't change until the queries are done
+  void load(const FlowTable& flows);
+
+  // rate a new flow on path (id in paths) with weight would get
+  double rate_if_added(int path, double weight);
+  // the path of candidates a new flow would get the highest rate on
+  // (the first of equals), -1 if there are none. its rate in *rate
+  int best_path(const int* candidates, int num_candidates, double weight, double* rate);
+  // all at once: new flows on add_paths with add_weights and active
+  // flows remove_flows (flow ids) taken out. sets add_rates[i] for each
+  // new flow and query_rates[i] for active flows query_flows[i]
+  // (-1 if it isn't active or is removed)
+  void evaluate(const int* add_paths, const double* add_weights, int num_adds,
+		const int* remove_flows, int num_removes,
+		const int* query_flows, int num_queries,
+		double* add_rates, double* query_rates);
+};
+
+#endif